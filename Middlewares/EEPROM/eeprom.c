@@ -18,13 +18,72 @@
 #include <rwwee.h>
 #include "string.h"
 #include "stdlib.h"
+#include "cmsis_os.h"
 
 extern struct eeprom_api eeprom_api1;
 extern struct eeprom_api eeprom_api2;
 
+/* EEPROM partition */
+struct eeprom_partition {
+    struct eeprom_api *api; /* engine instance */
+    uint32_t offset; /* start of the partition address range */
+    const char *name; /* usage */
+};
+
+/* Partition table, sorted by offset, each partition spans up to the next one */
+static const struct eeprom_partition mx_partitions[] = {
+    { &eeprom_api1, 0x00000000, "demo" },
+    { &eeprom_api2, 0x80000000, "perf" },
+};
+
+#define MX_EEPROM_PARTITIONS (sizeof(mx_partitions) / sizeof(mx_partitions[0]))
+
 extern int mx_ee_rww_init(void);
 extern void mx_ee_rww_deinit(void);
 
+/* Async write request */
+struct async_req {
+    uint32_t addr; /* start address */
+    uint32_t len; /* request length */
+    uint8_t *buf; /* pinned user buffer */
+    mx_eeprom_cb cb; /* completion callback */
+    void *arg; /* callback argument */
+};
+
+/* Async write barrier waiter */
+struct async_waiter {
+    osThreadId thread; /* waiting thread */
+    struct async_waiter *next; /* next waiter */
+};
+
+/* Async write information */
+struct async_info {
+    bool started; /* accepting requests */
+    osThreadId threadID; /* async write thread ID */
+    osMailQId queue; /* request queue */
+    osMutexId lock; /* submit lock */
+    osSemaphoreId slots; /* free request slots */
+    struct async_waiter *waiters; /* threads in mx_eeprom_wait() */
+    volatile uint32_t submitCnt; /* submitted requests */
+    volatile uint32_t doneCnt; /* completed requests */
+};
+
+static struct async_info mx_async = { .started = false, };
+
+/**
+ * @brief  Find the EEPROM partition holding an address.
+ * @param  addr: Address
+ * @retval Engine instance of the partition
+ */
+static struct eeprom_api *mx_eeprom_part(uint32_t addr) {
+    uint32_t i = MX_EEPROM_PARTITIONS - 1;
+
+    while (i && addr < mx_partitions[i].offset)
+        i--;
+
+    return mx_partitions[i].api;
+}
+
 /**
  * @brief  EEPROM read API.
  * @param  addr: Start address
@@ -33,14 +92,9 @@ extern void mx_ee_rww_deinit(void);
  * @retval Status
  */
 int mx_eeprom_read(uint32_t addr, uint32_t len, uint8_t *buf) {
-    int ret;
-
-    if (addr < eeprom_api2.offset)
-        ret = eeprom_api1.mx_eeprom_read(addr, len, buf);
-    else
-        ret = eeprom_api2.mx_eeprom_read(addr - eeprom_api2.offset, len, buf);
+    struct eeprom_api *api = mx_eeprom_part(addr);
 
-    return ret;
+    return api->mx_eeprom_read(addr - api->offset, len, buf);
 }
 /**
  * @brief  EEPROM write API.
@@ -50,39 +104,461 @@ int mx_eeprom_read(uint32_t addr, uint32_t len, uint8_t *buf) {
  * @retval Status
  */
 int mx_eeprom_write(uint32_t addr, uint32_t len, uint8_t *buf) {
+    struct eeprom_api *api = mx_eeprom_part(addr);
+
+    return api->mx_eeprom_write(addr - api->offset, len, buf);
+}
+
+/**
+ * @brief  EEPROM sync write API.
+ * @param  addr: Start address
+ * @param  len: Request length
+ * @param  buf: Data buffer
+ * @retval Status
+ */
+int mx_eeprom_sync_write(uint32_t addr, uint32_t len, uint8_t *buf) {
+    struct eeprom_api *api = mx_eeprom_part(addr);
+
+    return api->mx_eeprom_sync_write(addr - api->offset, len, buf);
+}
+
+/**
+ * @brief  EEPROM trim API, later reads of the trimmed pages return erased data.
+ * @param  addr: Start address
+ * @param  len: Range length
+ * @retval Status
+ */
+int mx_eeprom_trim(uint32_t addr, uint32_t len) {
+    struct eeprom_api *api = mx_eeprom_part(addr);
+
+    return api->mx_eeprom_trim(addr - api->offset, len);
+}
+
+/**
+ * @brief  Check that each segment lies in one EEPROM.
+ * @param  iov: Segments
+ * @param  cnt: Number of segments
+ * @retval Status
+ */
+static int mx_eeprom_iov_check(const struct eeprom_iovec *iov, uint32_t cnt) {
+    uint32_t i;
+    struct eeprom_api *api;
+
+    if (!iov)
+        return MX_EINVAL;
+
+    for (i = 0; i < cnt; i++) {
+        api = mx_eeprom_part(iov[i].addr);
+
+        if ((iov[i].addr - api->offset >= api->size) ||
+            (iov[i].len > api->size - (iov[i].addr - api->offset)))
+            return MX_EINVAL;
+    }
+
+    return MX_OK;
+}
+
+/**
+ * @brief  EEPROM vectored read API, segments may lie in any EEPROM.
+ * @param  iov: Segments
+ * @param  cnt: Number of segments
+ * @retval Status
+ */
+int mx_eeprom_readv(const struct eeprom_iovec *iov, uint32_t cnt) {
+    const struct eeprom_partition *part;
     int ret;
 
-    if (addr < eeprom_api2.offset)
-        ret = eeprom_api1.mx_eeprom_write(addr, len, buf);
-    else
-        ret = eeprom_api2.mx_eeprom_write(addr - eeprom_api2.offset, len, buf);
+    ret = mx_eeprom_iov_check(iov, cnt);
+    for (part = mx_partitions; !ret && part < mx_partitions + MX_EEPROM_PARTITIONS; part++)
+        ret = part->api->mx_eeprom_readv(iov, cnt, part->offset);
 
     return ret;
 }
 
 /**
- * @brief  EEPROM sync write API.
+ * @brief  EEPROM vectored write API, segments may lie in any EEPROM.
+ * @param  iov: Segments, later ones win where they overlap
+ * @param  cnt: Number of segments
+ * @retval Status
+ */
+int mx_eeprom_writev(const struct eeprom_iovec *iov, uint32_t cnt) {
+    const struct eeprom_partition *part;
+    int ret;
+
+    ret = mx_eeprom_iov_check(iov, cnt);
+    for (part = mx_partitions; !ret && part < mx_partitions + MX_EEPROM_PARTITIONS; part++)
+        ret = part->api->mx_eeprom_writev(iov, cnt, part->offset);
+
+    return ret;
+}
+
+/**
+ * @brief  EEPROM transaction begin API, in the EEPROM holding addr.
+ * @param  addr: Any address of the EEPROM
+ * @retval Status
+ */
+int mx_eeprom_tx_begin(uint32_t addr) {
+    return mx_eeprom_part(addr)->mx_eeprom_tx_begin();
+}
+
+/**
+ * @brief  EEPROM transaction write API, staged until commit.
  * @param  addr: Start address
  * @param  len: Request length
  * @param  buf: Data buffer
  * @retval Status
  */
-int mx_eeprom_sync_write(uint32_t addr, uint32_t len, uint8_t *buf) {
+int mx_eeprom_tx_write(uint32_t addr, uint32_t len, uint8_t *buf) {
+    struct eeprom_api *api = mx_eeprom_part(addr);
+
+    return api->mx_eeprom_tx_write(addr - api->offset, len, buf);
+}
+
+/**
+ * @brief  EEPROM transaction commit API, all staged writes or none of them
+ *         survive a power loss.
+ * @param  addr: Any address of the EEPROM
+ * @retval Status
+ */
+int mx_eeprom_tx_commit(uint32_t addr) {
+    return mx_eeprom_part(addr)->mx_eeprom_tx_commit();
+}
+
+/**
+ * @brief  EEPROM transaction abort API, drop the staged writes.
+ * @param  addr: Any address of the EEPROM
+ * @retval Status
+ */
+int mx_eeprom_tx_abort(uint32_t addr) {
+    return mx_eeprom_part(addr)->mx_eeprom_tx_abort();
+}
+
+/**
+ * @brief  EEPROM flush API, call it just before power down.
+ *         NOTE: All emulators write their superblock, so the next init
+ *               skips the power-cycle scan.
+ * @retval Status
+ */
+int mx_eeprom_flush(void) {
+    const struct eeprom_partition *part;
+    int ret;
+
+    /* Drain async writes first */
+    if (mx_async.started) {
+        ret = mx_eeprom_wait(osWaitForever);
+        if (ret)
+            return ret;
+    }
+
+    for (part = mx_partitions; part < mx_partitions + MX_EEPROM_PARTITIONS; part++) {
+        ret = part->api->mx_eeprom_flush();
+        if (ret)
+            return ret;
+    }
+
+    return MX_OK;
+}
+
+/**
+ * @brief  EEPROM async write thread.
+ * @param  arg: Unused
+ */
+static void mx_eeprom_async_thread(const void *arg) {
     int ret;
+    osEvent event;
+    struct async_req *req;
+    struct async_waiter *w;
+
+    for (;;) {
+        event = osMailGet(mx_async.queue, osWaitForever);
+        if (event.status != osEventMail)
+            continue;
+
+        req = event.value.p;
+
+        /* Program and flush in the background */
+        ret = mx_eeprom_sync_write(req->addr, req->len, req->buf);
+        if (ret)
+            printf("mxee_async: fail to write addr 0x%08lx, len %lu\r\n", req->addr, req->len);
+
+        /* Signal completion */
+        if (req->cb)
+            req->cb(req->addr, req->len, ret, req->arg);
+
+        osMailFree(mx_async.queue, req);
 
-    if (addr < eeprom_api2.offset)
-        ret = eeprom_api1.mx_eeprom_sync_write(addr, len, buf);
-    else
-        ret = eeprom_api2.mx_eeprom_sync_write(addr - eeprom_api2.offset, len, buf);
+        /* Wake every waiter, each one checks its own target */
+        osMutexWait(mx_async.lock, osWaitForever);
+        mx_async.doneCnt++;
+        for (w = mx_async.waiters; w; w = w->next)
+            osSignalSet(w->thread, MX_EEPROM_ASYNC_SIGNAL);
+        osMutexRelease(mx_async.lock);
+
+        osSemaphoreRelease(mx_async.slots);
+    }
+}
+
+/**
+ * @brief  EEPROM async write API.
+ *         NOTE: buf is pinned until the request completes, do not modify
+ *         or free it before cb is called or mx_eeprom_wait() returns.
+ *         Reads of the range may return old data until then.
+ * @param  addr: Start address
+ * @param  len: Request length
+ * @param  buf: Data buffer
+ * @param  cb: Completion callback, or NULL
+ * @param  arg: Callback argument
+ * @param  millisec: Time to wait for a free request slot when the queue is full
+ * @retval Status, MX_EBUSY if the queue stays full
+ */
+int mx_eeprom_write_async(uint32_t addr, uint32_t len, uint8_t *buf,
+                          mx_eeprom_cb cb, void *arg, uint32_t millisec) {
+    struct async_req *req;
+
+    if (!mx_async.started)
+        return MX_ENODEV;
+
+    if (!len || !buf)
+        return MX_EINVAL;
+
+    /* Backpressure: wait for a free request slot */
+    if (osSemaphoreWait(mx_async.slots, millisec))
+        return MX_EBUSY;
+
+    req = osMailAlloc(mx_async.queue, 0);
+    if (!req) {
+        osSemaphoreRelease(mx_async.slots);
+        return MX_ENOMEM;
+    }
+
+    req->addr = addr;
+    req->len = len;
+    req->buf = buf;
+    req->cb = cb;
+    req->arg = arg;
+
+    /* Keep the submit order of the request counter */
+    osMutexWait(mx_async.lock, osWaitForever);
+    mx_async.submitCnt++;
+    osMailPut(mx_async.queue, req);
+    osMutexRelease(mx_async.lock);
+
+    return MX_OK;
+}
+
+/**
+ * @brief  EEPROM async write barrier API.
+ *         Wait for all async writes submitted before this call to complete.
+ * @param  millisec: Timeout (ms), or osWaitForever
+ * @retval Status, MX_EBUSY on timeout
+ */
+int mx_eeprom_wait(uint32_t millisec) {
+    int ret = MX_OK;
+    uint32_t target, start, elapsed;
+    struct async_waiter w, **pp;
+
+    if (!mx_async.threadID)
+        return MX_ENODEV;
+
+    /* Register before reading the target, so no completion is missed */
+    w.thread = osThreadGetId();
+
+    osMutexWait(mx_async.lock, osWaitForever);
+    target = mx_async.submitCnt;
+    w.next = mx_async.waiters;
+    mx_async.waiters = &w;
+    osMutexRelease(mx_async.lock);
+
+    start = osKernelSysTick();
+
+    while ((int32_t)(mx_async.doneCnt - target) < 0) {
+        if (millisec == osWaitForever) {
+            osSignalWait(MX_EEPROM_ASYNC_SIGNAL, osWaitForever);
+            continue;
+        }
+
+        elapsed = osKernelSysTick() - start;
+        if (elapsed >= millisec) {
+            ret = MX_EBUSY;
+            break;
+        }
+
+        osSignalWait(MX_EEPROM_ASYNC_SIGNAL, millisec - elapsed);
+    }
+
+    osMutexWait(mx_async.lock, osWaitForever);
+    for (pp = &mx_async.waiters; *pp != &w; pp = &(*pp)->next)
+        ;
+    *pp = w.next;
+    osMutexRelease(mx_async.lock);
 
     return ret;
 }
 
+/**
+ * @brief  Start EEPROM async write thread.
+ *         NOTE: The mail queue can not be deleted, so the thread and its
+ *         objects are created once and kept across deinit. Objects created
+ *         before a failure are kept for the next attempt.
+ * @retval Status
+ */
+static int mx_eeprom_async_init(void) {
+    osMutexDef(asyncLock);
+    osSemaphoreDef(asyncSlots);
+    osMailQDef(asyncQueue, MX_EEPROM_ASYNC_DEPTH, struct async_req);
+    osThreadDef(eeasync, mx_eeprom_async_thread, MX_EEPROM_ASYNC_THREAD_PRIORITY, 0,
+                MX_EEPROM_ASYNC_THREAD_STACK_SIZE);
+
+    if (mx_async.threadID)
+        goto out;
+
+    if (!mx_async.lock)
+        mx_async.lock = osMutexCreate(osMutex(asyncLock));
+    if (!mx_async.slots)
+        mx_async.slots = osSemaphoreCreate(osSemaphore(asyncSlots), MX_EEPROM_ASYNC_DEPTH);
+    if (!mx_async.queue)
+        mx_async.queue = osMailCreate(osMailQ(asyncQueue), NULL);
+    if (!mx_async.lock || !mx_async.slots || !mx_async.queue) {
+        printf("mxee_init : out of memory (async)\r\n");
+        return MX_ENOMEM;
+    }
+
+    mx_async.submitCnt = 0;
+    mx_async.doneCnt = 0;
+
+    mx_async.threadID = osThreadCreate(osThread(eeasync), NULL);
+    if (!mx_async.threadID) {
+        printf("mxee_init : fail to start async write thread\r\n");
+        return MX_ENOMEM;
+    }
+
+    out:
+    mx_async.started = true;
+    return MX_OK;
+}
+
+/**
+ * @brief  EEPROM statistics API.
+ * @param  addr: Any address of the EEPROM to query
+ * @param  bank: Bank number, or MX_EEPROM_ALL_BANKS for the sum of all banks
+ * @param  stats: eeprom_stats structure pointer
+ * @retval Status
+ */
+int mx_eeprom_get_stats(uint32_t addr, uint32_t bank, struct eeprom_stats *stats) {
+    return mx_eeprom_part(addr)->mx_eeprom_get_stats(bank, stats);
+}
+
+/**
+ * @brief  EEPROM latency histogram API.
+ * @param  addr: Any address of the EEPROM to query
+ * @param  bank: Bank number, or MX_EEPROM_ALL_BANKS to merge all banks
+ * @param  lat: eeprom_latency structure pointer
+ * @retval Status
+ */
+int mx_eeprom_get_latency(uint32_t addr, uint32_t bank, struct eeprom_latency *lat) {
+    return mx_eeprom_part(addr)->mx_eeprom_get_latency(bank, lat);
+}
+
+/**
+ * @brief  EEPROM statistics and latency histogram reset API.
+ * @param  addr: Any address of the EEPROM to reset
+ * @param  bank: Bank number, or MX_EEPROM_ALL_BANKS for all banks
+ * @retval Status
+ */
+int mx_eeprom_reset_stats(uint32_t addr, uint32_t bank) {
+    return mx_eeprom_part(addr)->mx_eeprom_reset_stats(bank);
+}
+
+/**
+ * @brief  Write amplification of a bank, or of all banks.
+ * @param  stats: Statistics from mx_eeprom_get_stats()
+ * @retval Flash bytes programmed per 100 bytes written by the user, 0 if nothing written
+ */
+uint32_t mx_eeprom_wa_ratio(const struct eeprom_stats *stats) {
+    if (!stats->writeBytes)
+        return 0;
+
+    /* Data entries, including GC and WL copies, plus system records */
+    return (uint32_t)(((uint64_t)stats->progBytes + stats->sysProgBytes) * 100 / stats->writeBytes);
+}
+
+/**
+ * @brief  Estimate a latency percentile from a histogram.
+ * @param  lat: Latency histograms
+ * @param  op: Operation, MX_EEPROM_LAT_*
+ * @param  pct: Percentile, 1 ~ 100
+ * @retval Upper bound of the bucket holding the percentile (CPU cycles), 0 if empty
+ */
+uint32_t mx_eeprom_latency_pct(const struct eeprom_latency *lat, uint32_t op, uint32_t pct) {
+    uint64_t total = 0, target;
+    uint32_t i;
+
+    if (op >= MX_EEPROM_LAT_OPS)
+        return 0;
+
+    for (i = 0; i < MX_EEPROM_LAT_BUCKETS; i++)
+        total += lat->cnt[op][i];
+
+    if (!total)
+        return 0;
+
+    /* Rank of the percentile sample, rounded up */
+    target = (total * pct + 99) / 100;
+
+    for (i = 0; i < MX_EEPROM_LAT_BUCKETS - 1; i++) {
+        if (target <= lat->cnt[op][i])
+            break;
+        target -= lat->cnt[op][i];
+    }
+
+    /* The open-ended bucket and any bucket above the worst case end at the max */
+    if (i == MX_EEPROM_LAT_BUCKETS - 1 || (2UL << i) - 1 > lat->max[op])
+        return lat->max[op];
+
+    return (2UL << i) - 1;
+}
+
+/**
+ * @brief  Print p50/p99/max latency of each operation.
+ * @param  addr: Any address of the EEPROM to dump
+ * @param  bank: Bank number, or MX_EEPROM_ALL_BANKS to merge all banks
+ */
+void mx_eeprom_dump_latency(uint32_t addr, uint32_t bank) {
+    static const char *const name[MX_EEPROM_LAT_OPS] = { "read", "write", "flush", "erase" };
+    struct eeprom_latency lat;
+    uint32_t op, i, cnt, mhz = SystemCoreClock / 1000000;
+
+    if (mx_eeprom_get_latency(addr, bank, &lat))
+        return;
+
+    for (op = 0; op < MX_EEPROM_LAT_OPS; op++) {
+        for (cnt = 0, i = 0; i < MX_EEPROM_LAT_BUCKETS; i++)
+            cnt += lat.cnt[op][i];
+
+        printf("mxee_lat  : %-5s %8lu ops, p50 %lu us, p99 %lu us, max %lu us\r\n",
+               name[op], cnt,
+               mx_eeprom_latency_pct(&lat, op, 50) / mhz,
+               mx_eeprom_latency_pct(&lat, op, 99) / mhz,
+               lat.max[op] / mhz);
+    }
+}
+
+/**
+ * @brief  EEPROM read-ahead window API.
+ * @param  addr: Any address of the EEPROM to tune
+ * @param  pages: Read-ahead window (pages), 0 to disable read-ahead
+ * @retval Status
+ */
+int mx_eeprom_set_read_ahead(uint32_t addr, uint32_t pages) {
+    return mx_eeprom_part(addr)->mx_eeprom_set_read_ahead(pages);
+}
+
 /**
  * @brief  Initialize EEPROM Emulator.
  * @retval Status
  */
 int mx_eeprom_init(void) {
+    const struct eeprom_partition *part;
     int ret;
 
     ret = mx_ee_rww_init();
@@ -91,18 +567,19 @@ int mx_eeprom_init(void) {
         return ret;
     }
 
-    eeprom_api1.offset = 0;
-    printf("eeprom1 for demo, offs %x, size %x\r\n", eeprom_api1.offset, eeprom_api1.size);
-    eeprom_api2.offset = 0x80000000;
-    printf("eeprom2 for perf, offs %x, size %x\r\n", eeprom_api2.offset, eeprom_api2.size);
+    for (part = mx_partitions; part < mx_partitions + MX_EEPROM_PARTITIONS; part++) {
+        part->api->offset = part->offset;
+        printf("eeprom%u for %s, offs %x, size %x\r\n", (unsigned int)(part - mx_partitions) + 1,
+               part->name, part->api->offset, part->api->size);
 
-    ret = eeprom_api1.mx_eeprom_init();
-    if (ret)
-        return ret;
+        ret = part->api->mx_eeprom_init();
+        if (ret)
+            return ret;
+    }
 
-    ret = eeprom_api2.mx_eeprom_init();
-    if (ret)
-        return ret;
+    /* Async writes are optional, mx_eeprom_write_async() reports MX_ENODEV without them */
+    if (mx_eeprom_async_init())
+        printf("mxee_init : async writes disabled\r\n");
 
     return 0;
 }
@@ -111,8 +588,16 @@ int mx_eeprom_init(void) {
  * @brief  Deinit EEPROM Emulator.
  */
 void mx_eeprom_deinit(void) {
-    eeprom_api1.mx_eeprom_deinit();
-    eeprom_api2.mx_eeprom_deinit();
+    const struct eeprom_partition *part;
+
+    /* Stop accepting and drain async writes */
+    if (mx_async.started) {
+        mx_async.started = false;
+        mx_eeprom_wait(osWaitForever);
+    }
+
+    for (part = mx_partitions; part < mx_partitions + MX_EEPROM_PARTITIONS; part++)
+        part->api->mx_eeprom_deinit();
 }
 
 /**
@@ -120,17 +605,16 @@ void mx_eeprom_deinit(void) {
  * @retval Status
  */
 int mx_eeprom_format(void) {
+    const struct eeprom_partition *part;
     int ret;
 
     mx_eeprom_deinit();
 
-    ret = eeprom_api1.mx_eeprom_format();
-    if (ret)
-        return ret;
-
-    ret = eeprom_api2.mx_eeprom_format();
-    if (ret)
-        return ret;
+    for (part = mx_partitions; part < mx_partitions + MX_EEPROM_PARTITIONS; part++) {
+        ret = part->api->mx_eeprom_format();
+        if (ret)
+            return ret;
+    }
 
     return 0;
 }
@@ -190,6 +190,243 @@ int mx_ee_rww_erase(uint32_t addr, uint32_t len) {
     return (!ret ? MX_OK : MX_EIO);
 }
 
+/**
+ * @brief    Check if a NOR flash bank is busy programming or erasing.
+ * @param    addr: Any address of the bank
+ * @retval Busy (true) or idle (false)
+ */
+bool mx_ee_rww_busy(uint32_t addr) {
+    return ((busy_bank & 0x7F) & (1 << BANKS(addr))) != 0;
+}
+
+/* CRC peripheral shared by all EEPROM partitions */
+struct crc_info {
+    osMutexId lock; /* one transfer at a time, also guards the counts */
+    uint32_t users; /* partitions holding the peripheral */
+#ifdef MX_EEPROM_CRC_DMA
+    uint32_t dmaUsers; /* partitions holding the DMA */
+    osSemaphoreId dmaSem; /* DMA transfer done */
+#endif
+};
+
+static struct crc_info mx_crc;
+
+/* CRC handler */
+static CRC_HandleTypeDef hcrc;
+
+#ifdef MX_EEPROM_CRC_DMA
+/* DMA handler feeding the CRC peripheral */
+static DMA_HandleTypeDef hdma_crc;
+
+/**
+ * @brief    CRC DMA interrupt handler.
+ */
+void MX_EEPROM_CRC_DMA_IRQ_HANDLER(void) {
+    HAL_DMA_IRQHandler(&hdma_crc);
+}
+
+/**
+ * @brief    CRC DMA transfer complete or error callback, wake the waiter.
+ * @param    hdma: DMA handle
+ */
+static void mx_ee_crc_dma_done(DMA_HandleTypeDef *hdma) {
+    osSemaphoreRelease(mx_crc.dmaSem);
+}
+
+/**
+ * @brief    Init the DMA feeding the CRC peripheral.
+ *           NOTE: Must hold the CRC lock.
+ * @retval Status
+ */
+static int mx_ee_crc_dma_init(void) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+
+    hdma_crc.Instance = MX_EEPROM_CRC_DMA_CHANNEL;
+    hdma_crc.Init.Request = DMA_REQUEST_MEM2MEM;
+    hdma_crc.Init.Direction = DMA_MEMORY_TO_MEMORY;
+    hdma_crc.Init.PeriphInc = DMA_PINC_ENABLE;
+    hdma_crc.Init.MemInc = DMA_MINC_DISABLE;
+    hdma_crc.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_crc.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_crc.Init.Mode = DMA_NORMAL;
+    hdma_crc.Init.Priority = DMA_PRIORITY_LOW;
+
+    if (HAL_DMA_Init(&hdma_crc))
+        return MX_ENXIO;
+
+    hdma_crc.XferCpltCallback = mx_ee_crc_dma_done;
+    hdma_crc.XferErrorCallback = mx_ee_crc_dma_done;
+
+    /* Taken until a transfer completes */
+    osSemaphoreDef(crcSem);
+    mx_crc.dmaSem = osSemaphoreCreate(osSemaphore(crcSem), 1);
+    if (!mx_crc.dmaSem) {
+        HAL_DMA_DeInit(&hdma_crc);
+        return MX_ENOMEM;
+    }
+    osSemaphoreWait(mx_crc.dmaSem, 0);
+
+    HAL_NVIC_SetPriority(MX_EEPROM_CRC_DMA_IRQ, MX_EEPROM_CRC_DMA_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(MX_EEPROM_CRC_DMA_IRQ);
+
+    return MX_OK;
+}
+
+/**
+ * @brief    Deinit the DMA feeding the CRC peripheral.
+ *           NOTE: Must hold the CRC lock.
+ */
+static void mx_ee_crc_dma_deinit(void) {
+    HAL_NVIC_DisableIRQ(MX_EEPROM_CRC_DMA_IRQ);
+    HAL_DMA_DeInit(&hdma_crc);
+
+    osSemaphoreDelete(mx_crc.dmaSem);
+    mx_crc.dmaSem = NULL;
+}
+
+/**
+ * @brief    Accumulate CRC16 of word aligned data by DMA to the CRC peripheral.
+ *           NOTE: Must hold the CRC lock. Other threads run during the transfer,
+ *                 the caller sleeps until the transfer complete interrupt.
+ * @param    crc: CRC so far, returned CRC
+ * @param    data: Data words
+ * @param    words: Number of words
+ * @retval Status
+ */
+static int mx_ee_crc_dma(uint16_t *crc, const uint32_t *data, uint32_t words) {
+    WRITE_REG(hcrc.Instance->INIT, *crc);
+    __HAL_CRC_DR_RESET(&hcrc);
+
+    if (HAL_DMA_Start_IT(&hdma_crc, (uint32_t)data, (uint32_t)&hcrc.Instance->DR, words))
+        return MX_EIO;
+
+    if (osSemaphoreWait(mx_crc.dmaSem, MX_EEPROM_CRC_DMA_TIMEOUT) != osOK) {
+        HAL_DMA_Abort(&hdma_crc);
+
+        /* Drop a wake-up raced with the abort */
+        osSemaphoreWait(mx_crc.dmaSem, 0);
+        return MX_EIO;
+    }
+
+    if (hdma_crc.ErrorCode != HAL_DMA_ERROR_NONE)
+        return MX_EIO;
+
+    *crc = hcrc.Instance->DR & DATA_NONE16;
+
+    return MX_OK;
+}
+#endif
+
+/**
+ * @brief    Take a reference on the shared CRC peripheral, the first one
+ *           inits it.
+ * @param    dma: Also feed it by DMA
+ * @retval Status
+ */
+int mx_ee_crc_get(bool dma) {
+    int ret = MX_OK;
+
+#ifndef MX_EEPROM_CRC_DMA
+    if (dma)
+        return MX_ENODEV;
+#endif
+
+    if (!mx_crc.lock)
+        return MX_ENODEV;
+
+    if (osMutexWait(mx_crc.lock, osWaitForever))
+        return MX_EOS;
+
+    if (!mx_crc.users) {
+        hcrc.Instance = CRC;
+        hcrc.Init.GeneratingPolynomial = CRC16_POLY;
+        hcrc.Init.CRCLength = CRC_POLYLENGTH_16B;
+        hcrc.Init.DefaultInitValueUse = DEFAULT_INIT_VALUE_ENABLE;
+        hcrc.Init.InputDataInversionMode = CRC_INPUTDATA_INVERSION_NONE;
+        hcrc.Init.OutputDataInversionMode = CRC_OUTPUTDATA_INVERSION_DISABLE;
+        hcrc.InputDataFormat = CRC_INPUTDATA_FORMAT_WORDS;
+
+        if (HAL_CRC_Init(&hcrc)) {
+            ret = MX_ENXIO;
+            goto out;
+        }
+    }
+
+#ifdef MX_EEPROM_CRC_DMA
+    if (dma && !mx_crc.dmaUsers) {
+        ret = mx_ee_crc_dma_init();
+        if (ret) {
+            if (!mx_crc.users)
+                HAL_CRC_DeInit(&hcrc);
+            goto out;
+        }
+    }
+
+    if (dma)
+        mx_crc.dmaUsers++;
+#endif
+
+    mx_crc.users++;
+
+    out:
+    osMutexRelease(mx_crc.lock);
+    return ret;
+}
+
+/**
+ * @brief    Drop a reference on the shared CRC peripheral, the last one
+ *           deinits it.
+ * @param    dma: The reference was taken with DMA
+ */
+void mx_ee_crc_put(bool dma) {
+    if (!mx_crc.lock)
+        return;
+
+    osMutexWait(mx_crc.lock, osWaitForever);
+
+#ifdef MX_EEPROM_CRC_DMA
+    if (dma && mx_crc.dmaUsers && !--mx_crc.dmaUsers)
+        mx_ee_crc_dma_deinit();
+#endif
+
+    if (mx_crc.users && !--mx_crc.users)
+        HAL_CRC_DeInit(&hcrc);
+
+    osMutexRelease(mx_crc.lock);
+}
+
+/**
+ * @brief    Accumulate CRC16 of word aligned data on the shared CRC peripheral.
+ * @param    crc: CRC so far, CRC16_INIT to start, returned CRC
+ * @param    data: Data words
+ * @param    words: Number of words
+ * @param    dma: Feed it by DMA, the caller sleeps during the transfer
+ * @param    millisec: Timeout waiting for the peripheral, 0 to give up at once
+ * @retval Status, MX_EBUSY if the peripheral stayed in use
+ */
+int mx_ee_crc_hw(uint16_t *crc, const uint32_t *data, uint32_t words, bool dma, uint32_t millisec) {
+    int ret = MX_OK;
+
+    if (osMutexWait(mx_crc.lock, millisec))
+        return MX_EBUSY;
+
+    if (!mx_crc.users) {
+        ret = MX_ENODEV;
+#ifdef MX_EEPROM_CRC_DMA
+    } else if (dma && mx_crc.dmaUsers) {
+        ret = mx_ee_crc_dma(crc, data, words);
+#endif
+    } else {
+        WRITE_REG(hcrc.Instance->INIT, *crc);
+        __HAL_CRC_DR_RESET(&hcrc);
+        *crc = HAL_CRC_Accumulate(&hcrc, (uint32_t*) data, words) & DATA_NONE16;
+    }
+
+    osMutexRelease(mx_crc.lock);
+    return ret;
+}
+
 /**
  * @brief    Initialize RWW layer.
  * @retval Status
@@ -205,7 +442,18 @@ int mx_ee_rww_init(void) {
     xBufferMutex = xSemaphoreCreateMutex();
 #endif
     ret = MxInit(&Mxic);
-    return ret;
+    if (ret)
+        return ret;
+
+    /* Kept over EEPROM deinit and init, the partitions share it */
+    if (!mx_crc.lock) {
+        osMutexDef(crcLock);
+        mx_crc.lock = osMutexCreate(osMutex(crcLock));
+        if (!mx_crc.lock)
+            return MX_ENOMEM;
+    }
+
+    return MX_OK;
 }
 
 /**
@@ -220,4 +468,9 @@ void mx_ee_rww_deinit(void) {
     vSemaphoreDelete(xCommandMutex);
     vSemaphoreDelete(xBufferMutex);
 #endif
+
+    if (!mx_crc.users) {
+        osMutexDelete(mx_crc.lock);
+        mx_crc.lock = NULL;
+    }
 }
@@ -15,12 +15,144 @@
  * limitations under the License.
  */
 
-#ifndef RWWEE2_H_
-#define RWWEE2_H_
+#ifndef RWWEE_H_
+#define RWWEE_H_
 
 #include "stdbool.h"
 #include "stdio.h"
 
+/* Error codes */
+#define MX_OK              0    /* No error */
+#define MX_EINVAL          1    /* Invalid argument */
+#define MX_EFAULT          2    /* Bad address */
+#define MX_ENOSPC          3    /* No space left on device */
+#define MX_ENODEV          4    /* No such device */
+#define MX_ENOMEM          5    /* Out of memory */
+#define MX_EIO             6    /* I/O error */
+#define MX_ENXIO           7    /* No such device or address */
+#define MX_ENOFS           8    /* No valid file system */
+#define MX_EECC            9    /* ECC failure */
+#define MX_EPERM           10   /* Operation not permitted */
+#define MX_EOS             11   /* OS error */
+#define MX_EBUSY           12   /* Device or resource busy */
+
+/* Asynchronous write */
+#define MX_EEPROM_ASYNC_DEPTH              8                 /* Queued async write requests */
+#define MX_EEPROM_ASYNC_THREAD_PRIORITY    osPriorityLow     /* Async write thread priority */
+#define MX_EEPROM_ASYNC_THREAD_STACK_SIZE  256               /* Async write thread stack size */
+#define MX_EEPROM_ASYNC_SIGNAL             0x100000          /* Async write completion signal */
+
+/* CRC16 of the entries */
+#define CRC16_POLY                      (0x1021)
+#define CRC16_INIT                      (0xFFFF)
+
+/*
+ * CRC peripheral shared by the partitions on MX_EEPROM_CRC_BACKEND_HW or _DMA,
+ * owned by rww.c. Define MX_EEPROM_CRC_DMA for the _DMA backend.
+ */
+//#define MX_EEPROM_CRC_DMA
+#define MX_EEPROM_CRC_DMA_CHANNEL       DMA1_Channel7               /* Memory to memory channel */
+#define MX_EEPROM_CRC_DMA_IRQ           DMA1_Channel7_IRQn          /* Its transfer complete interrupt */
+#define MX_EEPROM_CRC_DMA_IRQ_HANDLER   DMA1_Channel7_IRQHandler    /* Defined by rww.c */
+#define MX_EEPROM_CRC_DMA_IRQ_PRIORITY  0x0F                        /* Must allow RTOS calls */
+#define MX_EEPROM_CRC_DMA_TIMEOUT       10                          /* DMA transfer timeout (ms) */
+
+/* Statistics of all banks */
+#define MX_EEPROM_ALL_BANKS    0xffffffffUL
+
+/* Latency histogram operations */
+#define MX_EEPROM_LAT_READ     0    /* user page read, bank lock wait included */
+#define MX_EEPROM_LAT_WRITE    1    /* user page write, bank lock wait included */
+#define MX_EEPROM_LAT_FLUSH    2    /* dirty page cache write-back */
+#define MX_EEPROM_LAT_ERASE    3    /* flash sector erase */
+#define MX_EEPROM_LAT_OPS      4
+#define MX_EEPROM_LAT_BUCKETS  24   /* log2 CPU cycle buckets, the last one open-ended */
+
+/* EEPROM statistics */
+struct eeprom_stats {
+    uint32_t hdrReadCnt; /* entry header reads */
+    uint32_t mapBuildCnt; /* mapping table builds */
+    uint32_t cacheHitCnt; /* page cache hits */
+    uint32_t cacheMissCnt; /* page cache misses */
+    uint32_t cacheEvictCnt; /* page cache evictions */
+    uint32_t raIssueCnt; /* read-ahead pages filled */
+    uint32_t raHitCnt; /* read-ahead pages hit by user reads */
+    uint32_t raWasteCnt; /* read-ahead pages evicted unused */
+    uint32_t mapLoadCnt; /* mapping checkpoint loads */
+    uint32_t mapSaveCnt; /* mapping checkpoint saves */
+    uint32_t mapSwitchCycles; /* block switch CPU cycles */
+    uint32_t mapHitCnt; /* block mapping cache hits */
+    uint32_t mapMissCnt; /* block mapping cache misses */
+    uint32_t eraseDeferCnt; /* sector erases queued */
+    uint32_t eraseBgCnt; /* sector erases done in background */
+    uint32_t eraseSyncCnt; /* sector erases done in foreground */
+    uint32_t workerReqCnt; /* sub-requests done by bank worker */
+    uint32_t workerBytes; /* bytes transferred by bank worker */
+    uint32_t workerCycles; /* bank worker busy CPU cycles */
+    uint32_t wearSaveCnt; /* erase count snapshots */
+    uint32_t wlCnt; /* static wear leveling relocations */
+    uint32_t gcCommitCnt; /* sync writes committed by group flushes */
+    uint32_t gcFlushCnt; /* group flushes */
+    uint32_t zcReadCnt; /* pages read bypassing the page cache */
+    uint32_t zcWriteCnt; /* pages written bypassing the page cache */
+    uint32_t sectorEraseCnt; /* data sector erases */
+    uint32_t reclaimCnt; /* sectors reclaimed by garbage collection */
+    uint32_t reclaimCopyCnt; /* valid entries relocated by garbage collection */
+    uint32_t writeBytes; /* logical bytes written */
+    uint32_t progBytes; /* data entry bytes programmed */
+    uint32_t deltaCnt; /* delta records journaled */
+    uint32_t deltaCompactCnt; /* full journals compacted into a new entry */
+    uint32_t elideCnt; /* no-op page writes elided */
+    uint32_t elideUs; /* estimated flash busy time saved by elision (us) */
+    uint32_t trimCnt; /* logical pages unmapped by trim */
+    uint32_t iovFragCnt; /* page fragments of vectored requests */
+    uint32_t iovMergeCnt; /* fragments merged into a neighbouring one */
+    uint32_t txCommitCnt; /* transactions committed */
+    uint32_t txPageCnt; /* pages programmed by transactions */
+    uint32_t txUndoCnt; /* pages of unfinished transactions rolled back */
+    uint32_t zipCnt; /* pages stored compressed */
+    uint32_t zipInBytes; /* page bytes compressed */
+    uint32_t zipOutBytes; /* compressed bytes stored */
+    uint32_t mountCycles; /* power-cycle check CPU cycles */
+    uint32_t mountScanCnt; /* blocks searched at mount */
+    uint32_t mountSkipCnt; /* blocks restored from the superblock */
+    uint32_t crcBytes; /* bytes checksummed */
+    uint32_t crcCycles; /* CRC CPU cycles, lock wait included */
+    uint32_t crcWaitCycles; /* CPU cycles waiting for the CRC peripheral */
+    uint32_t pageReadCnt; /* pages read from flash */
+    uint32_t pageWriteCnt; /* pages programmed */
+    uint32_t cacheFlushCnt; /* dirty page cache write-backs */
+    uint32_t crcErrCnt; /* CRC check failures */
+    uint32_t readRetryCnt; /* page read retries */
+    uint32_t sysProgBytes; /* system sector and OOB slot bytes programmed */
+    uint32_t gcProgBytes; /* entry bytes programmed by garbage collection */
+    uint32_t wlProgBytes; /* entry bytes programmed by wear leveling */
+    uint32_t eraseUserCnt; /* sectors erased after user updates */
+    uint32_t eraseGcCnt; /* sectors erased by garbage collection */
+    uint32_t eraseWlCnt; /* sectors erased by wear leveling */
+    uint32_t eraseFixCnt; /* sectors erased to repair the mapping at mount */
+    uint32_t eraseSysCnt; /* system sectors erased */
+};
+
+/* EEPROM latency histograms, bucket n counts operations of [2^n, 2^(n+1)) CPU cycles */
+struct eeprom_latency {
+    uint32_t cnt[MX_EEPROM_LAT_OPS][MX_EEPROM_LAT_BUCKETS]; /* operations per bucket */
+    uint32_t max[MX_EEPROM_LAT_OPS]; /* worst case CPU cycles */
+};
+
+/*
+ * Async write completion callback, called from the async write thread.
+ * status is the result of the underlying mx_eeprom_sync_write().
+ */
+typedef void (*mx_eeprom_cb)(uint32_t addr, uint32_t len, int status, void *arg);
+
+/* Vectored R/W segment */
+struct eeprom_iovec {
+    uint32_t addr; /* start address */
+    uint32_t len; /* segment length */
+    uint8_t *buf; /* data buffer */
+};
+
 struct eeprom_api {
     int (*mx_eeprom_format)(void);
     int (*mx_eeprom_init)(void);
@@ -28,16 +160,48 @@ struct eeprom_api {
     int (*mx_eeprom_read)(uint32_t addr, uint32_t len, uint8_t *buf);
     int (*mx_eeprom_write)(uint32_t addr, uint32_t len, uint8_t *buf);
     int (*mx_eeprom_sync_write)(uint32_t addr, uint32_t len, uint8_t *buf);
+    int (*mx_eeprom_trim)(uint32_t addr, uint32_t len);
+    int (*mx_eeprom_readv)(const struct eeprom_iovec *iov, uint32_t cnt, uint32_t base);
+    int (*mx_eeprom_writev)(const struct eeprom_iovec *iov, uint32_t cnt, uint32_t base);
+    int (*mx_eeprom_tx_begin)(void);
+    int (*mx_eeprom_tx_write)(uint32_t addr, uint32_t len, uint8_t *buf);
+    int (*mx_eeprom_tx_commit)(void);
+    int (*mx_eeprom_tx_abort)(void);
+    int (*mx_eeprom_flush)(void);
+    int (*mx_eeprom_get_stats)(uint32_t bank, struct eeprom_stats *stats);
+    int (*mx_eeprom_get_latency)(uint32_t bank, struct eeprom_latency *lat);
+    int (*mx_eeprom_reset_stats)(uint32_t bank);
+    int (*mx_eeprom_set_read_ahead)(uint32_t pages);
     uint32_t offset;
     uint32_t size;
 };
 
-/* eeprom.c */
+/* eeprom.c, hidden from the engine instances whose static functions share the names */
+#ifndef MX_EEPROM_ENGINE
 int mx_eeprom_read(uint32_t addr, uint32_t len, uint8_t *buf);
 int mx_eeprom_write(uint32_t addr, uint32_t len, uint8_t *buf);
 int mx_eeprom_sync_write(uint32_t addr, uint32_t len, uint8_t *buf);
+int mx_eeprom_trim(uint32_t addr, uint32_t len);
+int mx_eeprom_readv(const struct eeprom_iovec *iov, uint32_t cnt);
+int mx_eeprom_writev(const struct eeprom_iovec *iov, uint32_t cnt);
+int mx_eeprom_tx_begin(uint32_t addr);
+int mx_eeprom_tx_write(uint32_t addr, uint32_t len, uint8_t *buf);
+int mx_eeprom_tx_commit(uint32_t addr);
+int mx_eeprom_tx_abort(uint32_t addr);
+int mx_eeprom_flush(void);
+int mx_eeprom_write_async(uint32_t addr, uint32_t len, uint8_t *buf,
+                          mx_eeprom_cb cb, void *arg, uint32_t millisec);
+int mx_eeprom_wait(uint32_t millisec);
+int mx_eeprom_get_stats(uint32_t addr, uint32_t bank, struct eeprom_stats *stats);
+int mx_eeprom_get_latency(uint32_t addr, uint32_t bank, struct eeprom_latency *lat);
+int mx_eeprom_reset_stats(uint32_t addr, uint32_t bank);
+uint32_t mx_eeprom_wa_ratio(const struct eeprom_stats *stats);
+uint32_t mx_eeprom_latency_pct(const struct eeprom_latency *lat, uint32_t op, uint32_t pct);
+void mx_eeprom_dump_latency(uint32_t addr, uint32_t bank);
+int mx_eeprom_set_read_ahead(uint32_t addr, uint32_t pages);
 int mx_eeprom_format(void);
 int mx_eeprom_init(void);
 void mx_eeprom_deinit(void);
+#endif
 
-#endif /* RWWEE2_H_ */
+#endif /* RWWEE_H_ */
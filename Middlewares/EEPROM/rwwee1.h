@@ -15,111 +15,55 @@
  * limitations under the License.
  */
 
-#ifndef RWWEE2_H_
-#define RWWEE2_H_
+#ifndef RWWEE1_H_
+#define RWWEE1_H_
 
-#include "stdbool.h"
-#include "stdio.h"
-
-/* FreeRTOS includes */
-#include "cmsis_os.h"
-#include "stm32l4xx_hal.h"
-
-/* STM32 includes */
-//#include "stm32l4r9i_discovery_ospi_nor.h"
-#include "mx25lm51245g.h"
-
-#define __FREERTOS__
-
-#ifdef __FREERTOS__
-/* Use FreeRTOS */
-typedef TimeOut_t osTimeOut;
-#define osTaskDelay(xTicksToDelay) vTaskDelay(xTicksToDelay)
-#define osTaskSetTimeOutState(pxTimeOut) vTaskSetTimeOutState(pxTimeOut)
-#define osTaskCheckForTimeOut(pxTimeOut, pxTicksToWait) xTaskCheckForTimeOut(pxTimeOut, pxTicksToWait)
-#else
-/* Use Other RTOS */
-typedef osTimeOut;
-#define osTaskDelay(xTicksToDelay)
-#define osTaskSetTimeOutState(pxTimeOut)
-#define osTaskCheckForTimeOut(pxTimeOut, pxTicksToWait)
-#error "please define RTOS APIs!"
+#ifdef MX_EEPROM_API
+#error "only one partition configuration header per source file!"
 #endif
 
-/* Flash specifications */
-#define MX_FLASH_CHUNK_SIZE             MX25LM51245G_CHUNK_SIZE
-#define MX_FLASH_PAGE_SIZE              MX25LM51245G_PAGE_SIZE
-#define MX_FLASH_SECTOR_SIZE            MX25LM51245G_SECTOR_SIZE
-#define MX_FLASH_BLOCK_SIZE             MX25LM51245G_BLOCK_SIZE
-#define MX_FLASH_TOTAL_SIZE             MX25LM51245G_FLASH_SIZE
-
-#ifdef MX_FLASH_SUPPORT_RWW
-/* Typical PP/SE/BE busy ticks */
-#define MX_FLASH_PAGE_WRITE_TICKS       (1 / portTICK_PERIOD_MS)    /* include SW delay */
-#define MX_FLASH_SECTOR_ERASE_TICKS     (24 / portTICK_PERIOD_MS)
-#define MX_FLASH_BLOCK_ERASE_TICKS      (220 / portTICK_PERIOD_MS)
-
-/* Flash bank information */
-#define MX_FLASH_BANK_SIZE              MX25LM51245G_BANK_SIZE
-#define MX_FLASH_BANK_SIZE_MASK         MX25LM51245G_BANK_SIZE_MASK
-#define MX_FLASH_BANKS                  (MX_FLASH_TOTAL_SIZE / MX_FLASH_BANK_SIZE)
-#endif
+/*
+ * EEPROM partition 1 configuration: large entries, many small clusters.
+ * The partition runs its own instance of the shared engine (eeprom_engine.inc,
+ * rwwee_engine.h), built from eeprom1.c with the settings below.
+ */
+
+/* Partition instance */
+#define MX_EEPROM_API                   eeprom_api1
+#define MX_EEPROM_BANK_OFFSETS          { 0x00200000, 0x01200000, 0x02200000, 0x03200000 }
 
 /* EEPROM physical layout */
 #define MX_EEPROM_SECTORS_PER_CLUSTER   (32)
 #define MX_EEPROM_CLUSTERS_PER_BANK     (112)
 #define MX_EEPROM_BANKS                 (4)
-#define MX_EEPROM_CLUSTER_SIZE          (MX_FLASH_SECTOR_SIZE * MX_EEPROM_SECTORS_PER_CLUSTER)
-#define MX_EEPROM_BANK_SIZE             (MX_EEPROM_CLUSTER_SIZE * MX_EEPROM_CLUSTERS_PER_BANK)
 
-#if defined(MX_FLASH_BANKS) && (MX_EEPROM_BANKS > MX_FLASH_BANKS)
-#error "too many banks!"
-#endif
+/* Out-of-band entry headers, logical pages fill whole entries (new on-flash format) */
+//#define MX_EEPROM_OOB_HEADER
 
-#if (MX_EEPROM_SECTORS_PER_CLUSTER > 256)
-#error "too many sectors per cluster!"
-#endif
+/* Page-level log-structured mapping (new on-flash format) */
+//#define MX_EEPROM_PAGE_MAPPING
 
-/* EEPROM parameters */
-#define MX_EEPROM_HEADER_SIZE           (4)
-#define MX_EEPROM_ENTRY_SIZE            (MX_FLASH_SECTOR_SIZE) //2048 or 4096
-#define MX_EEPROM_PAGE_SIZE             (MX_EEPROM_ENTRY_SIZE - MX_EEPROM_HEADER_SIZE)
-#define MX_EEPROM_ENTRIES_PER_SECTOR    (MX_FLASH_SECTOR_SIZE / MX_EEPROM_ENTRY_SIZE)
-#define MX_EEPROM_SYSTEM_SECTOR         (MX_EEPROM_SECTORS_PER_CLUSTER - 1)
-#define MX_EEPROM_SYSTEM_SECTOR_OFFSET  (MX_EEPROM_SYSTEM_SECTOR * MX_FLASH_SECTOR_SIZE)
-#define MX_EEPROM_SYSTEM_ENTRY_SIZE     (16)
-#define MX_EEPROM_SYSTEM_ENTRIES        (MX_FLASH_SECTOR_SIZE / MX_EEPROM_SYSTEM_ENTRY_SIZE)
-#define MX_EEPROM_DATA_SECTORS          (MX_EEPROM_SYSTEM_SECTOR)
-#define MX_EEPROM_FREE_SECTORS          (1)
-#define MX_EEPROM_ENTRIES_PER_CLUSTER   (MX_EEPROM_ENTRIES_PER_SECTOR * MX_EEPROM_DATA_SECTORS)
-#define MX_EEPROM_LPAS_PER_CLUSTER      (MX_EEPROM_DATA_SECTORS - MX_EEPROM_FREE_SECTORS)
-#define MX_EEPROM_BLOCK_SIZE            (MX_EEPROM_PAGE_SIZE * MX_EEPROM_LPAS_PER_CLUSTER)
-#define MX_EEPROM_BLOCKS                (MX_EEPROM_CLUSTERS_PER_BANK)
-#define MX_EEPROM_SIZE                  (MX_EEPROM_BLOCK_SIZE * MX_EEPROM_BLOCKS)
-#define MX_EEPROMS                      (MX_EEPROM_BANKS)
-#define MX_EEPROM_TOTAL_SIZE            (MX_EEPROM_SIZE * MX_EEPROMS)
-
-#if (MX_EEPROM_ENTRY_SIZE < MX_FLASH_CHUNK_SIZE)
-#error "too small data entry size!"
-#endif
+/* Delta journal of small writes in the entry tail (new on-flash format) */
+//#define MX_EEPROM_DELTA_JOURNAL
 
-#if (MX_EEPROM_ENTRIES_PER_SECTOR > 256)
-#error "too many entries per sector!"
-#endif
+/* Transparent run-length compression of entry data (new on-flash format) */
+//#define MX_EEPROM_COMPRESSION
 
-#if (MX_EEPROM_SYSTEM_ENTRY_SIZE < MX_FLASH_CHUNK_SIZE)
-#error "too small system entry size!"
+/* Data entry size */
+#ifdef MX_EEPROM_PAGE_MAPPING
+#define MX_EEPROM_ENTRY_SIZE            (512)
+#else
+#define MX_EEPROM_ENTRY_SIZE            (MX_FLASH_SECTOR_SIZE) //2048 or 4096
 #endif
 
-#define MX_EEPROM_HASH_CROSSBANK        0    /* Page hash */
-#define MX_EEPROM_HASH_HYBRID           1    /* Block hash */
-#define MX_EEPROM_HASH_SEQUENTIAL       2    /* Bank hash */
-
 /* Address hash algorithm */
 #define MX_EEPROM_HASH_AlGORITHM        MX_EEPROM_HASH_CROSSBANK
 
-/* Wear leveling interval */
-#define MX_EEPROM_WL_INTERVAL           10000
+/* Erase count spread to trigger static wear leveling */
+#define MX_EEPROM_WL_THRESHOLD          64
+
+/* Page writes per bank between static wear leveling checks */
+#define MX_EEPROM_WL_WRITES             64
 
 #ifdef MX_EEPROM_BACKGROUND_THREAD
 #define MX_EEPROM_BG_THREAD_PRIORITY    osPriorityLow               /* Background thread priority */
@@ -131,201 +75,87 @@ typedef osTimeOut;
 /* HW CRC protection */
 #define MX_EEPROM_CRC_HW
 
-#ifdef MX_EEPROM_PC_PROTECTION
+/* CRC16 backend: MX_EEPROM_CRC_BACKEND_HW, _SW or _DMA */
+#define MX_EEPROM_CRC_BACKEND           MX_EEPROM_CRC_BACKEND_SW
+#define MX_EEPROM_CRC_DMA_MIN           256                         /* Smallest buffer fed by DMA (bytes) */
 
-#ifndef MX_EEPROM_CRC_HW
-#define MX_EEPROM_CRC_HW
-#endif
+/* Persistent erase counts in system sector */
+#define MX_EEPROM_WEAR_SAVE_INTERVAL    32   /* Erases between erase count snapshots per block */
 
-#if !defined(MX_FLASH_SUPPORT_RWW) && !defined(MX_EEPROM_ECC_CHECK)
-#define MX_EEPROM_ECC_CHECK
-#endif
+/* Mapping table checkpoint in system sector */
+#define MX_EEPROM_MAP_CHECKPOINT
 
-#ifndef MX_EEPROM_READ_ROLLBACK
-#define MX_EEPROM_READ_ROLLBACK
-#endif
+#define MX_EEPROM_WRITE_RETRIES         2    /* number of write retries */
 
-#endif
+#define MX_EEPROM_READ_RETRIES          2    /* number of read retries */
 
-#if defined(MX_FLASH_SUPPORT_RWW) && defined(MX_EEPROM_ECC_CHECK)
-#error "cannot read ECC status in RWW mode!"
-#endif
+#define MX_EEPROM_CACHE_ENTRIES         2    /* page cache entries per bank */
 
-#ifdef MX_EEPROM_CRC_HW
-#define CRC16_POLY                      (0x1021)
-#define CRC16_DATA_LENGTH               (MX_EEPROM_PAGE_SIZE / 4)
-#endif
+#define MX_EEPROM_MAP_CACHE_ENTRIES     4    /* block mapping cache entries per bank */
 
-#define MX_EEPROM_WRITE_RETRIES         2    /* number of write retries */
+/* Zero-copy R/W of whole, word aligned pages */
+#define MX_EEPROM_ZERO_COPY
 
-#define MX_EEPROM_READ_RETRIES          2    /* number of read retries */
+/* Skip programming pages rewritten with identical data */
+#define MX_EEPROM_WRITE_ELISION
 
-#if defined(MX_EEPROM_READ_ROLLBACK) && (MX_EEPROM_READ_RETRIES == 0)
-#error "please set the number of read retries!"
-#endif
+/* Sequential read-ahead */
+#define MX_EEPROM_READ_AHEAD
 
-#if defined(MX_GENERIC_RWW) && !defined(MX_FLASH_SUPPORT_RWW)
-#error "please enable RWW feature!"
+#ifdef MX_EEPROM_READ_AHEAD
+#define MX_EEPROM_RA_STREAMS            2                           /* Tracked sequential streams */
+#define MX_EEPROM_RA_TRIGGER            2                           /* Sequential reads to start read-ahead */
+#define MX_EEPROM_RA_WINDOW             MX_EEPROMS                  /* Default read-ahead window (pages) */
+#define MX_EEPROM_RA_THREAD_PRIORITY    osPriorityLow               /* Read-ahead thread priority */
+#define MX_EEPROM_RA_THREAD_STACK_SIZE  256                         /* Read-ahead thread stack size */
+#define MX_EEPROM_RA_THREAD_TIMEOUT     10                          /* Read-ahead thread timeout (ms) */
 #endif
 
-/* RWWEE ID: "MX" */
-#define MFTL_ID            0x4D58
-
-/* Error codes */
-#define MX_OK              0    /* No error */
-#define MX_EINVAL          1    /* Invalid argument */
-#define MX_EFAULT          2    /* Bad address */
-#define MX_ENOSPC          3    /* No space left on device */
-#define MX_ENODEV          4    /* No such device */
-#define MX_ENOMEM          5    /* Out of memory */
-#define MX_EIO             6    /* I/O error */
-#define MX_ENXIO           7    /* No such device or address */
-#define MX_ENOFS           8    /* No valid file system */
-#define MX_EECC            9    /* ECC failure */
-#define MX_EPERM           10   /* Operation not permitted */
-#define MX_EOS             11   /* OS error */
-
-/* Maximum unsigned value */
-#define DATA_NONE8         0xff
-#define DATA_NONE16        0xffff
-#define DATA_NONE32        0xffffffffUL
-
-/* fred: For testing */
-extern osMutexId UartLock;
-#define pr_time(fmt, ...) ({                                \
-    osMutexWait(UartLock, osWaitForever);                   \
-    printf("[%lu] " fmt, osKernelSysTick(), ##__VA_ARGS__); \
-    osMutexRelease(UartLock); })
-
-#ifdef MX_DEBUG
-#define mx_log(...)
-#define mx_info(args...) do {printf(args);} while(0)
-#define mx_err(args...) do {printf(args);} while(0)
-#else
-#define mx_log(...)
-#define mx_info(...)
-#define mx_err(...)
+/* Per-bank I/O workers */
+#define MX_EEPROM_BANK_WORKERS
+
+#ifdef MX_EEPROM_BANK_WORKERS
+#define MX_EEPROM_WORKER_QUEUE_DEPTH      4                           /* Pending sub-requests per bank */
+#define MX_EEPROM_WORKER_THREAD_PRIORITY  osPriorityLow               /* Worker thread priority, raised to the caller's */
+#define MX_EEPROM_WORKER_THREAD_STACK_SIZE 256                        /* Worker thread stack size */
+#define MX_EEPROM_WORKER_THREAD_TIMEOUT   1000                        /* Worker thread timeout (ms) */
 #endif
 
-/* Macros */
-#undef min_t
-#define min_t(type, x, y) ({ \
-    type __min1 = (x);       \
-    type __min2 = (y);       \
-    __min1 < __min2 ? __min1: __min2; })
-
-/* RWWEE operations */
-typedef enum {
-    OPS_READ = 0x5244,
-    OPS_WRITE = 0x7772,
-    OPS_ERASE_BEGIN = 0x4553,
-    OPS_ERASE_END = 0x6565,
-    OPS_NONE = 0x4E4E,
-} rwwee_ops;
-
-#pragma pack(1)    /* byte alignment */
-
-/* System Entry */
-struct system_entry {
-    uint16_t id;
-    uint16_t ops;
-    uint16_t arg;
-    uint16_t cksum;
-};
-
-/* Data entry header */
-struct eeprom_header {
-    uint8_t LPA;
-    uint8_t LPA_inv;
-    uint16_t crc;
-    uint8_t pad[MX_EEPROM_HEADER_SIZE - 4];
-};
-
-/* Data Entry */
-struct eeprom_entry {
-    struct eeprom_header header;
-    uint8_t data[MX_EEPROM_PAGE_SIZE];
-};
-
-#pragma pack()    /* default alignment */
-
-/* Bank information */
-struct bank_info {
-    uint32_t bank; /* current bank */
-    uint32_t bank_offset; /* bank address */
-
-    uint32_t block; /* current block */
-    uint32_t block_offset; /* block address */
-    struct eeprom_entry cache; /* entry cache */
-    bool cache_dirty; /* cache status */
-
-    /* address mapping */
-    uint8_t l2ps[MX_EEPROM_LPAS_PER_CLUSTER];
-    uint8_t l2pe[MX_EEPROM_LPAS_PER_CLUSTER];
-    uint8_t p2l[MX_EEPROM_DATA_SECTORS]; /* TODO: bitmap */
-
-    uint32_t dirty_block; /* obsoleted sector to be erased */
-    uint32_t dirty_sector; /* obsoleted sector to be erased */
-
-    /* system entry address */
-    uint32_t sys_entry[MX_EEPROM_BLOCKS];
-
-    osMutexId lock; /* bank mutex lock */
-
-#ifdef MX_DEBUG
-   /* sector erase count statistics */
-   uint32_t eraseCnt[MX_EEPROM_BLOCKS][MX_EEPROM_SECTORS_PER_CLUSTER];
+/* Deferred sector erase */
+#define MX_EEPROM_DEFERRED_ERASE
+
+#ifdef MX_EEPROM_DEFERRED_ERASE
+#define MX_EEPROM_ERASE_QUEUE_DEPTH       8                           /* Obsoleted sectors queued per bank */
+#define MX_EEPROM_ERASE_RESERVE           MX_EEPROM_FREE_SECTORS      /* Pre-erased sectors kept per block */
+#define MX_EEPROM_ERASE_THREAD_PRIORITY   osPriorityLow               /* Erase thread priority */
+#define MX_EEPROM_ERASE_THREAD_STACK_SIZE 256                         /* Erase thread stack size */
+#define MX_EEPROM_ERASE_THREAD_DELAY      100                         /* Erase thread idle poll period (ms) */
+#define MX_EEPROM_ERASE_THREAD_TIMEOUT    100                         /* Erase thread timeout (ms) */
 #endif
-};
 
-/* RWW information */
-struct rww_info {
-    bool initialized; /* EEPROM status */
+/* Group commit of concurrent sync writes */
+#define MX_EEPROM_GROUP_COMMIT
 
-#ifdef MX_FLASH_SUPPORT_RWW
-    uint32_t busyBank;          /* current busy bank */
-    TickType_t waitTicks;       /* ticks to wait */
-    osTimeOut timeout;          /* busy start time */
-    osMutexId busyLock;         /* RWW lock */
+#ifdef MX_EEPROM_GROUP_COMMIT
+#define MX_EEPROM_GC_WINDOW               2                           /* Batching window (ms), 0: join in-flight flush only */
 #endif
 
-    osMutexId deviceLock; /* device lock */
-};
+/* Vectored R/W */
+#define MX_EEPROM_IOV_FRAGS               16                          /* Page fragments sorted per batch */
 
-/* EEPROM information */
-struct eeprom_info {
-    bool initialized; /* EEPROM status */
+/* Atomic multi-page transactions */
+#define MX_EEPROM_TRANSACTION
 
-#ifdef MX_EEPROM_BACKGROUND_THREAD
-    bool bgStart;                     /* Background thread control */
-    osThreadId bgThreadID;            /* Background thread ID */
+#ifdef MX_EEPROM_TRANSACTION
+#define MX_EEPROM_TX_BANK                 0                           /* Bank of the transaction log */
+#define MX_EEPROM_TX_BLOCK                0                           /* Block of the transaction log, in its system sector */
+#define MX_EEPROM_TX_PAGES                (MX_EEPROMS * MX_EEPROM_CACHE_ENTRIES) /* Staged pages, in private buffers */
 #endif
 
-    struct bank_info bi[MX_EEPROMS]; /* bank info */
-
-    osMutexId crcLock; /* HW CRC mutex lock */
-
-    uint32_t rwCnt; /* User R/W statistics */
-};
-
-/* EEPROM parameter */
-struct eeprom_param {
-    uint32_t eeprom_page_size;
-    uint32_t eeprom_bank_size;
-    uint32_t eeprom_banks;
-    uint32_t eeprom_total_size;
-    uint32_t eeprom_hash_algorithm;
-};
-
-struct eeprom_api {
-    int (*mx_eeprom_format)(void);
-    int (*mx_eeprom_init)(void);
-    void (*mx_eeprom_deinit)(void);
-    int (*mx_eeprom_read)(uint32_t addr, uint32_t len, uint8_t *buf);
-    int (*mx_eeprom_write)(uint32_t addr, uint32_t len, uint8_t *buf);
-    int (*mx_eeprom_sync_write)(uint32_t addr, uint32_t len, uint8_t *buf);
-    uint32_t offset;
-    uint32_t size;
-};
-
-#endif /* RWWEE2_H_ */
+/* Per-bank mount threads */
+#define MX_EEPROM_MOUNT_THREAD_PRIORITY   osPriorityNormal            /* Scan thread priority */
+#define MX_EEPROM_MOUNT_THREAD_STACK_SIZE 512                         /* Scan thread stack size */
+
+#include "rwwee_engine.h"
+
+#endif /* RWWEE1_H_ */
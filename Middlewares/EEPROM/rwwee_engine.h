@@ -0,0 +1,831 @@
+/*
+ * Copyright (c) 2022-2023 Macronix International Co. LTD. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * EEPROM emulator engine definitions, shared by all partitions.
+ *
+ * Do not include this file directly, include the partition configuration
+ * header (rwwee1.h, rwwee2.h) instead: it sets the partition geometry and
+ * features, then includes this file.
+ */
+
+#ifndef RWWEE_ENGINE_H_
+#define RWWEE_ENGINE_H_
+
+#ifndef MX_EEPROM_API
+#error "please include the partition configuration header!"
+#endif
+
+#include "stdbool.h"
+#include "stdio.h"
+
+/* FreeRTOS includes */
+#include "cmsis_os.h"
+#include "stm32l4xx_hal.h"
+
+/* STM32 includes */
+//#include "stm32l4r9i_discovery_ospi_nor.h"
+#include "mx25lm51245g.h"
+
+/* Public types and error codes */
+#include "rwwee.h"
+
+#define __FREERTOS__
+
+#ifdef __FREERTOS__
+/* Use FreeRTOS */
+typedef TimeOut_t osTimeOut;
+#define osTaskDelay(xTicksToDelay) vTaskDelay(xTicksToDelay)
+#define osTaskSetTimeOutState(pxTimeOut) vTaskSetTimeOutState(pxTimeOut)
+#define osTaskCheckForTimeOut(pxTimeOut, pxTicksToWait) xTaskCheckForTimeOut(pxTimeOut, pxTicksToWait)
+#else
+/* Use Other RTOS */
+typedef osTimeOut;
+#define osTaskDelay(xTicksToDelay)
+#define osTaskSetTimeOutState(pxTimeOut)
+#define osTaskCheckForTimeOut(pxTimeOut, pxTicksToWait)
+#error "please define RTOS APIs!"
+#endif
+
+/* Flash specifications */
+#define MX_FLASH_CHUNK_SIZE             MX25LM51245G_CHUNK_SIZE
+#define MX_FLASH_PAGE_SIZE              MX25LM51245G_PAGE_SIZE
+#define MX_FLASH_SECTOR_SIZE            MX25LM51245G_SECTOR_SIZE
+#define MX_FLASH_BLOCK_SIZE             MX25LM51245G_BLOCK_SIZE
+#define MX_FLASH_TOTAL_SIZE             MX25LM51245G_FLASH_SIZE
+
+#ifdef MX_FLASH_SUPPORT_RWW
+/* Typical PP/SE/BE busy ticks */
+#define MX_FLASH_PAGE_WRITE_TICKS       (1 / portTICK_PERIOD_MS)    /* include SW delay */
+#define MX_FLASH_SECTOR_ERASE_TICKS     (24 / portTICK_PERIOD_MS)
+#define MX_FLASH_BLOCK_ERASE_TICKS      (220 / portTICK_PERIOD_MS)
+
+/* Flash bank information */
+#define MX_FLASH_BANK_SIZE              MX25LM51245G_BANK_SIZE
+#define MX_FLASH_BANK_SIZE_MASK         MX25LM51245G_BANK_SIZE_MASK
+#define MX_FLASH_BANKS                  (MX_FLASH_TOTAL_SIZE / MX_FLASH_BANK_SIZE)
+#endif
+
+/* EEPROM physical layout */
+#define MX_EEPROM_CLUSTER_SIZE          (MX_FLASH_SECTOR_SIZE * MX_EEPROM_SECTORS_PER_CLUSTER)
+#define MX_EEPROM_BANK_SIZE             (MX_EEPROM_CLUSTER_SIZE * MX_EEPROM_CLUSTERS_PER_BANK)
+
+#if defined(MX_FLASH_BANKS) && (MX_EEPROM_BANKS > MX_FLASH_BANKS)
+#error "too many banks!"
+#endif
+
+#if (MX_EEPROM_SECTORS_PER_CLUSTER > 256)
+#error "too many sectors per cluster!"
+#endif
+
+/* EEPROM parameters */
+#ifdef MX_EEPROM_COMPRESSION
+#define MX_EEPROM_ZIP_HEADER_SIZE       (4)
+#else
+#define MX_EEPROM_ZIP_HEADER_SIZE       (0)
+#endif
+#ifdef MX_EEPROM_OOB_HEADER
+#define MX_EEPROM_HEADER_SIZE           (0)
+#define MX_EEPROM_OOB_SLOT_SIZE         (MX_FLASH_CHUNK_SIZE)
+#if (MX_FLASH_SECTOR_SIZE / MX_EEPROM_ENTRY_SIZE > 1)
+/* Headers in the last entry of each sector */
+#define MX_EEPROM_OOB_IN_SECTOR
+#define MX_EEPROM_ENTRIES_PER_SECTOR    (MX_FLASH_SECTOR_SIZE / MX_EEPROM_ENTRY_SIZE - 1)
+#else
+/* Headers in the system sector */
+#define MX_EEPROM_OOB_IN_SYSTEM
+#define MX_EEPROM_ENTRIES_PER_SECTOR    (1)
+#endif
+#else
+#ifdef MX_EEPROM_PAGE_MAPPING
+#define MX_EEPROM_HEADER_SIZE           (8 + MX_EEPROM_ZIP_HEADER_SIZE)
+#else
+#define MX_EEPROM_HEADER_SIZE           (4 + MX_EEPROM_ZIP_HEADER_SIZE)
+#endif
+#define MX_EEPROM_ENTRIES_PER_SECTOR    (MX_FLASH_SECTOR_SIZE / MX_EEPROM_ENTRY_SIZE)
+#endif
+#ifdef MX_EEPROM_DELTA_JOURNAL
+#define MX_EEPROM_JOURNAL_SIZE          (MX_EEPROM_ENTRY_SIZE / 8)
+#else
+#define MX_EEPROM_JOURNAL_SIZE          (0)
+#endif
+#define MX_EEPROM_PAGE_SIZE             (MX_EEPROM_ENTRY_SIZE - MX_EEPROM_HEADER_SIZE - MX_EEPROM_JOURNAL_SIZE)
+#define MX_EEPROM_SYSTEM_SECTOR         (MX_EEPROM_SECTORS_PER_CLUSTER - 1)
+#define MX_EEPROM_SYSTEM_SECTOR_OFFSET  (MX_EEPROM_SYSTEM_SECTOR * MX_FLASH_SECTOR_SIZE)
+#define MX_EEPROM_SYSTEM_ENTRY_SIZE     (16)
+#define MX_EEPROM_SYSTEM_ENTRIES        (MX_FLASH_SECTOR_SIZE / MX_EEPROM_SYSTEM_ENTRY_SIZE)
+#define MX_EEPROM_DATA_SECTORS          (MX_EEPROM_SYSTEM_SECTOR)
+#define MX_EEPROM_FREE_SECTORS          (1)
+#define MX_EEPROM_ENTRIES_PER_CLUSTER   (MX_EEPROM_ENTRIES_PER_SECTOR * MX_EEPROM_DATA_SECTORS)
+#ifdef MX_EEPROM_PAGE_MAPPING
+/* Half of the entries are spare, so garbage collection moves little data */
+#define MX_EEPROM_LOG_LPAS              ((MX_EEPROM_DATA_SECTORS - MX_EEPROM_FREE_SECTORS) * \
+                                         MX_EEPROM_ENTRIES_PER_SECTOR / 2)
+#if (MX_EEPROM_LOG_LPAS > 254)
+#define MX_EEPROM_LPAS_PER_CLUSTER      (254)
+#else
+#define MX_EEPROM_LPAS_PER_CLUSTER      MX_EEPROM_LOG_LPAS
+#endif
+#else
+#define MX_EEPROM_LPAS_PER_CLUSTER      (MX_EEPROM_DATA_SECTORS - MX_EEPROM_FREE_SECTORS)
+#endif
+#define MX_EEPROM_BLOCK_SIZE            (MX_EEPROM_PAGE_SIZE * MX_EEPROM_LPAS_PER_CLUSTER)
+#define MX_EEPROM_BLOCKS                (MX_EEPROM_CLUSTERS_PER_BANK)
+#define MX_EEPROM_SIZE                  (MX_EEPROM_BLOCK_SIZE * MX_EEPROM_BLOCKS)
+#define MX_EEPROMS                      (MX_EEPROM_BANKS)
+#define MX_EEPROM_TOTAL_SIZE            (MX_EEPROM_SIZE * MX_EEPROMS)
+
+#if (MX_EEPROM_ENTRY_SIZE < MX_FLASH_CHUNK_SIZE)
+#error "too small data entry size!"
+#endif
+
+#if (MX_EEPROM_ENTRIES_PER_SECTOR > 256)
+#error "too many entries per sector!"
+#endif
+
+#if defined(MX_EEPROM_PAGE_MAPPING) && (MX_EEPROM_ENTRIES_PER_SECTOR < 2)
+#error "page mapping needs several entries per sector!"
+#endif
+
+#if (MX_EEPROM_SYSTEM_ENTRY_SIZE < MX_FLASH_CHUNK_SIZE)
+#error "too small system entry size!"
+#endif
+
+#if defined(MX_EEPROM_OOB_IN_SECTOR) && \
+    (MX_EEPROM_ENTRIES_PER_SECTOR * MX_EEPROM_OOB_SLOT_SIZE > MX_EEPROM_ENTRY_SIZE)
+#error "too many entry headers per sector!"
+#endif
+
+#define MX_EEPROM_HASH_CROSSBANK        0    /* Page hash */
+#define MX_EEPROM_HASH_HYBRID           1    /* Block hash */
+#define MX_EEPROM_HASH_SEQUENTIAL       2    /* Bank hash */
+
+#ifdef MX_EEPROM_PC_PROTECTION
+
+#ifndef MX_EEPROM_CRC_HW
+#define MX_EEPROM_CRC_HW
+#endif
+
+#if !defined(MX_FLASH_SUPPORT_RWW) && !defined(MX_EEPROM_ECC_CHECK)
+#define MX_EEPROM_ECC_CHECK
+#endif
+
+#ifndef MX_EEPROM_READ_ROLLBACK
+#define MX_EEPROM_READ_ROLLBACK
+#endif
+
+#endif
+
+#if defined(MX_FLASH_SUPPORT_RWW) && defined(MX_EEPROM_ECC_CHECK)
+#error "cannot read ECC status in RWW mode!"
+#endif
+
+#ifdef MX_EEPROM_CRC_HW
+#define CRC16_DATA_LENGTH               (MX_EEPROM_PAGE_SIZE / 4)
+
+/* CRC16 backend */
+#define MX_EEPROM_CRC_BACKEND_HW        0                           /* CRC peripheral, one caller at a time */
+#define MX_EEPROM_CRC_BACKEND_SW        1                           /* Slicing-by-8 tables, no lock */
+#define MX_EEPROM_CRC_BACKEND_DMA       2                           /* Peripheral fed by DMA for large buffers if idle, else tables */
+
+#if (MX_EEPROM_CRC_BACKEND != MX_EEPROM_CRC_BACKEND_SW)
+#define MX_EEPROM_CRC_PERIPH
+#endif
+
+#if (MX_EEPROM_CRC_BACKEND != MX_EEPROM_CRC_BACKEND_HW)
+#define MX_EEPROM_CRC_TABLE
+#endif
+
+#if (MX_EEPROM_CRC_BACKEND == MX_EEPROM_CRC_BACKEND_DMA) && !defined(MX_EEPROM_CRC_DMA)
+#error "please define MX_EEPROM_CRC_DMA in rwwee.h for the DMA CRC backend!"
+#endif
+
+#endif
+
+#define MX_EEPROM_SYSTEM_DATA_SIZE      (MX_EEPROM_SYSTEM_ENTRY_SIZE - 8)
+
+/* Persistent erase counts in system sector */
+#define MX_EEPROM_WEAR_SLOTS            ((MX_EEPROM_DATA_SECTORS * 2 + MX_EEPROM_SYSTEM_DATA_SIZE - 1) \
+                                         / MX_EEPROM_SYSTEM_DATA_SIZE)
+
+#ifdef MX_EEPROM_OOB_IN_SYSTEM
+/* Entry headers carried over to a fresh system sector */
+#define MX_EEPROM_OOB_CARRY             (MX_EEPROM_DATA_SECTORS)
+#define MX_EEPROM_OOB_SCAN_RECORDS      16   /* System records per header scan read */
+#else
+#define MX_EEPROM_OOB_CARRY             (0)
+#endif
+
+#if (MX_EEPROM_WEAR_SLOTS * 2 + MX_EEPROM_OOB_CARRY > MX_EEPROM_SYSTEM_ENTRIES)
+#error "too large erase count snapshot!"
+#endif
+
+/* Mapping table checkpoint in system sector */
+#ifdef MX_EEPROM_MAP_CHECKPOINT
+#ifndef MX_EEPROM_CRC_HW
+#error "please enable HW CRC for mapping checkpoint!"
+#endif
+
+#ifdef MX_EEPROM_PAGE_MAPPING
+#define MX_EEPROM_MAP_SIZE              (MX_EEPROM_LPAS_PER_CLUSTER * 2 + MX_EEPROM_DATA_SECTORS * 4 + 6)
+#else
+#define MX_EEPROM_MAP_SIZE              (MX_EEPROM_LPAS_PER_CLUSTER * 3 + MX_EEPROM_DATA_SECTORS * 3)
+#endif
+#define MX_EEPROM_MAP_SLOTS             ((MX_EEPROM_MAP_SIZE + MX_EEPROM_SYSTEM_DATA_SIZE - 1) \
+                                         / MX_EEPROM_SYSTEM_DATA_SIZE + 1)
+
+#if (MX_EEPROM_MAP_SLOTS + MX_EEPROM_WEAR_SLOTS + MX_EEPROM_OOB_CARRY > MX_EEPROM_SYSTEM_ENTRIES)
+#error "too large mapping checkpoint!"
+#endif
+#endif
+
+#if defined(MX_EEPROM_READ_ROLLBACK) && (MX_EEPROM_READ_RETRIES == 0)
+#error "please set the number of read retries!"
+#endif
+
+#if (MX_EEPROM_CACHE_ENTRIES < 1)
+#error "please set the number of page cache entries!"
+#endif
+
+#if (MX_EEPROM_MAP_CACHE_ENTRIES < 1) || (MX_EEPROM_MAP_CACHE_ENTRIES > MX_EEPROM_BLOCKS)
+#error "please set the number of block mapping cache entries!"
+#endif
+
+#if defined(MX_EEPROM_ZERO_COPY) && !defined(MX_EEPROM_OOB_HEADER) && \
+    (MX_EEPROM_ENTRY_SIZE - MX_EEPROM_JOURNAL_SIZE <= MX_FLASH_PAGE_SIZE)
+#error "zero-copy needs entries larger than a flash page!"
+#endif
+
+#ifdef MX_EEPROM_DELTA_JOURNAL
+#define MX_EEPROM_DELTA_SLOT_SIZE       (MX_FLASH_CHUNK_SIZE)       /* Journal program unit */
+#define MX_EEPROM_DELTA_HEADER_SIZE     (8)                         /* Delta record header */
+/* Largest journaled update, a record spans up to four slots */
+#define MX_EEPROM_DELTA_MAX             (MX_EEPROM_DELTA_SLOT_SIZE * 4 - MX_EEPROM_DELTA_HEADER_SIZE)
+
+#ifndef MX_EEPROM_CRC_HW
+#error "please enable HW CRC for delta journal!"
+#endif
+
+#if (MX_EEPROM_JOURNAL_SIZE < MX_EEPROM_DELTA_MAX + MX_EEPROM_DELTA_HEADER_SIZE)
+#error "too small delta journal!"
+#endif
+#endif
+
+#ifdef MX_EEPROM_COMPRESSION
+#define MX_EEPROM_ZIP_RUN_MIN           (3)                         /* Shortest run coded as a repeat */
+#define MX_EEPROM_ZIP_RUN_MAX           (MX_EEPROM_ZIP_RUN_MIN + 127) /* Longest run of a repeat token */
+#define MX_EEPROM_ZIP_LIT_MAX           (128)                       /* Longest literal token */
+/* Largest compressed data stored, saving at least one flash page program */
+#define MX_EEPROM_ZIP_MAX               (((MX_EEPROM_ENTRY_SIZE - MX_EEPROM_JOURNAL_SIZE + MX_FLASH_PAGE_SIZE - 1) / \
+                                         MX_FLASH_PAGE_SIZE - 1) * MX_FLASH_PAGE_SIZE - MX_EEPROM_HEADER_SIZE)
+
+#ifdef MX_EEPROM_OOB_HEADER
+#error "compression needs the entry headers in data entries!"
+#endif
+
+#if (MX_EEPROM_ZIP_MAX < MX_FLASH_CHUNK_SIZE)
+#error "compression saves no flash page program!"
+#endif
+#endif
+
+/* Write elision cost model */
+#ifdef MX_EEPROM_WRITE_ELISION
+#define MX_EEPROM_PAGE_PROGRAM_US       (150)                       /* Typical flash page program time (us) */
+#define MX_EEPROM_SECTOR_ERASE_US       (24000)                     /* Typical sector erase time (us) */
+/* Flash busy time of an entry write, with its share of a sector erase */
+#define MX_EEPROM_ELIDE_US              ((MX_EEPROM_ENTRY_SIZE - MX_EEPROM_JOURNAL_SIZE) / MX_FLASH_PAGE_SIZE * \
+                                         MX_EEPROM_PAGE_PROGRAM_US + MX_EEPROM_SECTOR_ERASE_US / MX_EEPROM_ENTRIES_PER_SECTOR)
+#endif
+
+/* Sequential read-ahead */
+#ifdef MX_EEPROM_READ_AHEAD
+#define MX_EEPROM_RA_MAX_WINDOW         (MX_EEPROMS * MX_EEPROM_CACHE_ENTRIES) /* Read-ahead queue depth */
+
+#if (MX_EEPROM_HASH_AlGORITHM != MX_EEPROM_HASH_CROSSBANK)
+#error "read-ahead only supports crossbank hash!"
+#endif
+
+#if (MX_EEPROM_RA_WINDOW > MX_EEPROM_RA_MAX_WINDOW)
+#error "too large read-ahead window!"
+#endif
+#endif
+
+/* Per-bank I/O workers */
+#ifdef MX_EEPROM_BANK_WORKERS
+#define MX_EEPROM_WORKER_SIGNAL           0x100                       /* Completion signal of bank 0 */
+
+#if (MX_EEPROM_HASH_AlGORITHM != MX_EEPROM_HASH_CROSSBANK)
+#error "bank workers only support crossbank hash!"
+#endif
+#endif
+
+/* Deferred sector erase */
+#ifdef MX_EEPROM_DEFERRED_ERASE
+#define MX_EEPROM_ERASE_CARRY             (MX_EEPROM_ERASE_QUEUE_DEPTH) /* Obsolete records carried over to a fresh system sector */
+#define MX_EEPROM_ERASE_SCAN_RECORDS      8                           /* System records per obsolete scan read */
+
+#if (MX_EEPROM_ERASE_RESERVE < 1) || (MX_EEPROM_ERASE_RESERVE > MX_EEPROM_FREE_SECTORS)
+#error "please set the number of pre-erased sectors!"
+#endif
+
+#if (MX_EEPROM_WEAR_SLOTS * 2 + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY > MX_EEPROM_SYSTEM_ENTRIES)
+#error "too deep erase queue!"
+#endif
+#else
+#define MX_EEPROM_ERASE_CARRY             (0)
+#endif
+
+/* Trimmed pages, logged in the system sector */
+#ifdef MX_EEPROM_PAGE_MAPPING
+#define MX_EEPROM_TRIM_GROUPS             ((MX_EEPROM_LPAS_PER_CLUSTER + 7) / 8) /* Trim records per block, 8 pages each */
+#define MX_EEPROM_TRIM_CARRY              (MX_EEPROM_TRIM_GROUPS)     /* Trim records carried over to a fresh system sector */
+#define MX_EEPROM_TRIM_SCAN_RECORDS       8                           /* System records per trim scan read */
+
+#if (MX_EEPROM_WEAR_SLOTS * 2 + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY + MX_EEPROM_TRIM_CARRY > \
+     MX_EEPROM_SYSTEM_ENTRIES)
+#error "too many trim records!"
+#endif
+
+#if defined(MX_EEPROM_MAP_CHECKPOINT) && \
+    (MX_EEPROM_MAP_SLOTS + MX_EEPROM_WEAR_SLOTS + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY + MX_EEPROM_TRIM_CARRY > \
+     MX_EEPROM_SYSTEM_ENTRIES)
+#error "too large mapping checkpoint!"
+#endif
+#else
+#define MX_EEPROM_TRIM_CARRY              (0)
+#endif
+
+/* Group commit of concurrent sync writes */
+#ifdef MX_EEPROM_GROUP_COMMIT
+#define MX_EEPROM_GC_SIGNAL               0x1000                      /* Commit done signal */
+#endif
+
+/* Atomic multi-page transactions */
+#ifdef MX_EEPROM_TRANSACTION
+#define MX_EEPROM_TX_CARRY                (MX_EEPROM_TX_PAGES + 2)    /* Log records carried over to a fresh system sector */
+
+#ifdef MX_EEPROM_PAGE_MAPPING
+#error "transactions only support sector mapping!"
+#endif
+
+#ifdef MX_EEPROM_OOB_IN_SYSTEM
+#error "transactions need the entry headers in data sectors!"
+#endif
+
+#if (MX_EEPROM_WEAR_SLOTS * 2 + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY + MX_EEPROM_TX_CARRY > \
+     MX_EEPROM_SYSTEM_ENTRIES)
+#error "too many transaction pages!"
+#endif
+
+#if defined(MX_EEPROM_MAP_CHECKPOINT) && \
+    (MX_EEPROM_MAP_SLOTS + MX_EEPROM_WEAR_SLOTS + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY + MX_EEPROM_TX_CARRY > \
+     MX_EEPROM_SYSTEM_ENTRIES)
+#error "too large mapping checkpoint!"
+#endif
+#else
+#define MX_EEPROM_TX_CARRY                (0)
+#endif
+
+/* Clean-shutdown superblock, committed by CRC */
+#ifdef MX_EEPROM_CRC_HW
+#define MX_EEPROM_SUPERBLOCK
+#endif
+
+#define MX_EEPROM_MOUNT_SIGNAL            0x10000                     /* Mount done signal of bank 0 */
+
+#ifdef MX_EEPROM_SUPERBLOCK
+#define MX_EEPROM_SB_BLOCK                (MX_EEPROM_BLOCKS - 1)      /* Block of the superblock, in its system sector */
+#define MX_EEPROM_SB_SLOTS                ((MX_EEPROM_BLOCKS + MX_EEPROM_SYSTEM_DATA_SIZE - 1) \
+                                           / MX_EEPROM_SYSTEM_DATA_SIZE + 1)
+
+#define MX_EEPROM_SB_NONE                 0                           /* No valid superblock, scan at mount */
+#define MX_EEPROM_SB_CLEAN                1                           /* Superblock is the latest record */
+#define MX_EEPROM_SB_OPEN                 2                           /* Blocks logged since the superblock */
+
+#if (MX_EEPROM_SYSTEM_ENTRIES > 256)
+#error "system entry address does not fit the superblock!"
+#endif
+
+#if (MX_EEPROM_SB_SLOTS + MX_EEPROM_WEAR_SLOTS + MX_EEPROM_OOB_CARRY + MX_EEPROM_ERASE_CARRY + MX_EEPROM_TX_CARRY + \
+     MX_EEPROM_TRIM_CARRY > MX_EEPROM_SYSTEM_ENTRIES)
+#error "too large superblock!"
+#endif
+#endif
+
+#if defined(MX_GENERIC_RWW) && !defined(MX_FLASH_SUPPORT_RWW)
+#error "please enable RWW feature!"
+#endif
+
+/* RWWEE ID: "MX" */
+#define MFTL_ID            0x4D58
+
+/* Maximum unsigned value */
+#define DATA_NONE8         0xff
+#define DATA_NONE16        0xffff
+#define DATA_NONE32        0xffffffffUL
+
+/* fred: For testing */
+extern osMutexId UartLock;
+#define pr_time(fmt, ...) ({                                \
+    osMutexWait(UartLock, osWaitForever);                   \
+    printf("[%lu] " fmt, osKernelSysTick(), ##__VA_ARGS__); \
+    osMutexRelease(UartLock); })
+
+#ifdef MX_DEBUG
+#define mx_log(...)
+#define mx_info(args...) do {printf(args);} while(0)
+#define mx_err(args...) do {printf(args);} while(0)
+#else
+#define mx_log(...)
+#define mx_info(...)
+#define mx_err(...)
+#endif
+
+/* Macros */
+#undef min_t
+#define min_t(type, x, y) ({ \
+    type __min1 = (x);       \
+    type __min2 = (y);       \
+    __min1 < __min2 ? __min1: __min2; })
+
+/* RWWEE operations */
+typedef enum {
+    OPS_READ = 0x5244,
+    OPS_WRITE = 0x7772,
+    OPS_ERASE_BEGIN = 0x4553,
+    OPS_ERASE_END = 0x6565,
+    OPS_NONE = 0x4E4E,
+    OPS_MAP = 0x4D50,
+    OPS_CHECKPOINT = 0x4350,
+    OPS_WEAR = 0x5745,
+    OPS_HEADER = 0x4844,
+    OPS_TX_BEGIN = 0x5442,
+    OPS_TX_PAGE = 0x5450,
+    OPS_TX_COMMIT = 0x5443,
+    OPS_TX_END = 0x5445,
+    OPS_SUPER = 0x5342,
+    OPS_CLEAN = 0x434C,
+    OPS_OPEN = 0x4F50,
+    OPS_ACTIVE = 0x4143,
+    OPS_OBSOLETE = 0x4F42,
+    OPS_TRIM = 0x544D,
+} rwwee_ops;
+
+#pragma pack(1)    /* byte alignment */
+
+/* System Entry */
+struct system_entry {
+    uint16_t id;
+    uint16_t ops;
+    uint16_t arg;
+    uint16_t cksum;
+};
+
+/* System record */
+struct system_record {
+    struct system_entry sys;
+    uint8_t data[MX_EEPROM_SYSTEM_ENTRY_SIZE - sizeof(struct system_entry)];
+};
+
+/* Data entry header */
+struct eeprom_header {
+    uint8_t LPA;
+    uint8_t LPA_inv;
+    uint16_t crc;
+#ifdef MX_EEPROM_PAGE_MAPPING
+    uint32_t seq; /* block write sequence, the latest version wins */
+#elif (MX_EEPROM_HEADER_SIZE > 4 + MX_EEPROM_ZIP_HEADER_SIZE)
+    uint8_t pad[MX_EEPROM_HEADER_SIZE - 4 - MX_EEPROM_ZIP_HEADER_SIZE];
+#endif
+#ifdef MX_EEPROM_COMPRESSION
+    uint16_t zlen; /* compressed data length, DATA_NONE16 if stored plain */
+    uint16_t zlen_inv; /* redundant compressed data length */
+#endif
+};
+
+/* Data Entry */
+struct eeprom_entry {
+    struct eeprom_header header;
+    uint8_t data[MX_EEPROM_PAGE_SIZE];
+#ifdef MX_EEPROM_DELTA_JOURNAL
+    uint8_t journal[MX_EEPROM_JOURNAL_SIZE]; /* delta records, erased if empty */
+#endif
+};
+
+#ifdef MX_EEPROM_DELTA_JOURNAL
+/* Delta record header, data follows and is padded to whole journal slots */
+struct eeprom_delta {
+    uint16_t ofs; /* page offset */
+    uint8_t len; /* data length */
+    uint8_t len_inv; /* redundant data length */
+    uint16_t crc; /* header and data CRC */
+    uint16_t pad;
+};
+#endif
+
+#ifdef MX_EEPROM_TRANSACTION
+/* Transaction page, logged in the data of a system record */
+struct tx_page {
+    uint8_t bank; /* bank of the page */
+    uint8_t LPA; /* local logical page address */
+    uint16_t block; /* local block address */
+    uint16_t entry; /* latest entry before the transaction, DATA_NONE16 if none */
+    uint16_t cksum; /* page info checksum */
+};
+#endif
+
+#pragma pack()    /* default alignment */
+
+/* Page cache entry */
+struct eeprom_cache {
+    struct eeprom_entry entry; /* cached page */
+    uint32_t block; /* owner block */
+    uint32_t age; /* last access time */
+    bool dirty; /* cache status */
+    bool prefetched; /* filled by read-ahead, not yet used */
+#ifdef MX_EEPROM_TRANSACTION
+    bool tx; /* staged by the open transaction, never evicted */
+#endif
+#ifdef MX_EEPROM_DELTA_JOURNAL
+    uint16_t dofs; /* dirty range start */
+    uint16_t dend; /* dirty range end */
+#endif
+};
+
+/* Block mapping */
+struct block_map {
+    uint32_t block; /* mapped block */
+    uint32_t age; /* last access time */
+
+    /* address mapping */
+#ifdef MX_EEPROM_PAGE_MAPPING
+    uint16_t l2p[MX_EEPROM_LPAS_PER_CLUSTER]; /* latest entry */
+    uint8_t valid[MX_EEPROM_DATA_SECTORS]; /* valid entries per sector */
+    uint16_t log; /* next entry of the open log sector, DATA_NONE16: none */
+    uint32_t seq; /* next entry write sequence */
+    uint8_t p2l[MX_EEPROM_DATA_SECTORS]; /* LPA of the first entry */
+#else
+    uint8_t l2ps[MX_EEPROM_LPAS_PER_CLUSTER];
+    uint8_t l2pe[MX_EEPROM_LPAS_PER_CLUSTER]; /* latest entry index */
+    uint8_t l2pf[MX_EEPROM_LPAS_PER_CLUSTER]; /* next free entry index, 0: none */
+    uint8_t p2l[MX_EEPROM_DATA_SECTORS];
+#endif
+    uint32_t free[(MX_EEPROM_DATA_SECTORS + 31) / 32]; /* free sector bitmap */
+
+    /* wear leveling */
+    uint16_t wear[MX_EEPROM_DATA_SECTORS]; /* sector erase counts */
+    uint32_t wear_unsaved; /* erases since the last snapshot */
+
+#ifdef MX_EEPROM_OOB_IN_SYSTEM
+    /* out-of-band entry headers */
+    struct eeprom_header oob[MX_EEPROM_DATA_SECTORS];
+#endif
+
+#ifdef MX_EEPROM_MAP_CHECKPOINT
+    bool map_saved; /* mapping checkpointed */
+#endif
+};
+
+/* Bank worker sub-request, every MX_EEPROMS-th logical page of a request */
+struct bank_req {
+    uint32_t addr; /* global logical start address, in a page of the bank */
+    uint32_t len; /* bytes of the bank */
+    uint8_t *buf; /* data buffer of the first page */
+    bool rw; /* read (false) or write (true) */
+    int ret; /* completion status */
+    osThreadId caller; /* thread to signal on completion */
+};
+
+#ifdef MX_EEPROM_TRANSACTION
+/* Transaction staged page */
+struct tx_buf {
+    uint32_t bank; /* bank of the page */
+    uint32_t block; /* local block address */
+    uint32_t LPA; /* local logical page address */
+    uint32_t mask[(MX_EEPROM_PAGE_SIZE + 31) / 32]; /* staged bytes, bitmap */
+    uint8_t data[MX_EEPROM_PAGE_SIZE]; /* staged data */
+};
+#endif
+
+/* Vectored R/W page fragment */
+struct iov_frag {
+    uint32_t bank; /* bank of the logical page */
+    uint32_t addr; /* local logical start address */
+    uint32_t len; /* fragment length, within one logical page */
+    uint8_t *buf; /* data buffer */
+};
+
+/* Group commit waiter */
+struct gc_waiter {
+    struct gc_waiter *next; /* next waiter */
+    osThreadId thread; /* waiting sync writer */
+    uint32_t target; /* first group flush covering the write */
+    int ret; /* commit status */
+    volatile bool done; /* committed */
+    volatile bool leader; /* take over the next group flush */
+};
+
+/* Sector erase causes */
+#define MX_EEPROM_ERASE_USER    0    /* obsoleted by user updates */
+#define MX_EEPROM_ERASE_GC      1    /* reclaimed by garbage collection */
+#define MX_EEPROM_ERASE_WL      2    /* freed by wear leveling */
+#define MX_EEPROM_ERASE_FIX     3    /* mapping conflict or interrupted erase */
+
+/* Deferred erase request */
+struct erase_req {
+    uint16_t block; /* local block address */
+    uint16_t sector; /* obsoleted sector */
+    uint8_t cause; /* erase cause */
+};
+
+/* Bank information */
+struct bank_info {
+    uint32_t bank; /* current bank */
+    uint32_t bank_offset; /* bank address */
+
+    uint32_t block; /* current block */
+    uint32_t block_offset; /* block address */
+    struct eeprom_cache cache[MX_EEPROM_CACHE_ENTRIES]; /* page cache */
+    uint32_t cache_age; /* page cache LRU clock */
+
+    /* address mapping cache */
+    struct block_map maps[MX_EEPROM_MAP_CACHE_ENTRIES];
+    struct block_map *map; /* mapping of current block */
+    uint32_t map_age; /* mapping cache LRU clock */
+
+    uint32_t dirty_block; /* obsoleted sector to be erased */
+    uint32_t dirty_sector; /* obsoleted sector to be erased */
+
+#ifdef MX_EEPROM_PAGE_MAPPING
+    /* garbage collection */
+    struct eeprom_entry reclaim_buf; /* relocated entry */
+    uint32_t seq_buf[MX_EEPROM_LPAS_PER_CLUSTER]; /* latest sequence per LPA, mapping build and trim scan only */
+    bool reclaiming; /* relocation in progress */
+
+    /* trimmed pages */
+    struct system_record trim_rec[MX_EEPROM_TRIM_SCAN_RECORDS]; /* trim scan buffer */
+    uint8_t trim_buf[MX_EEPROM_TRIM_GROUPS]; /* trimmed pages to carry over, bitmap */
+    uint32_t trim_seq; /* write sequence of the carried trims */
+#endif
+
+#if (defined(MX_EEPROM_ZERO_COPY) || defined(MX_EEPROM_COMPRESSION)) && !defined(MX_EEPROM_OOB_HEADER)
+    uint8_t chunk[MX_FLASH_PAGE_SIZE]; /* header and head of user data, or compressed data */
+#endif
+
+#if defined(MX_EEPROM_ZERO_COPY) && defined(MX_EEPROM_DELTA_JOURNAL)
+    uint32_t journal[MX_EEPROM_JOURNAL_SIZE / 4]; /* journal of a page read bypassing the page cache */
+#endif
+
+#if defined(MX_EEPROM_ZERO_COPY) && defined(MX_EEPROM_WRITE_ELISION)
+    uint8_t cmp_buf[MX_FLASH_PAGE_SIZE]; /* stored page compared with a zero-copy write */
+#endif
+
+#ifdef MX_EEPROM_BANK_WORKERS
+    osMessageQId queue; /* sub-request queue */
+    osThreadId worker; /* worker thread ID */
+#endif
+
+#ifdef MX_EEPROM_DEFERRED_ERASE
+    /* deferred erase queue */
+    struct erase_req erase_q[MX_EEPROM_ERASE_QUEUE_DEPTH];
+    uint32_t erase_cnt; /* queued sectors */
+    bool erase_urgent; /* free sectors below reserve */
+    struct system_record erase_rec[MX_EEPROM_ERASE_SCAN_RECORDS]; /* obsolete scan buffer */
+#endif
+
+    /* system entry address */
+    uint32_t sys_entry[MX_EEPROM_BLOCKS];
+
+    /* erase count snapshot buffer */
+    struct system_record wear_rec[MX_EEPROM_WEAR_SLOTS];
+    uint16_t wear_buf[MX_EEPROM_DATA_SECTORS];
+
+#ifdef MX_EEPROM_OOB_IN_SYSTEM
+    /* out-of-band entry header buffers */
+    struct eeprom_header oob_buf[MX_EEPROM_DATA_SECTORS];
+    struct system_record oob_rec[MX_EEPROM_OOB_SCAN_RECORDS];
+#endif
+
+#ifdef MX_EEPROM_MAP_CHECKPOINT
+    /* mapping checkpoint */
+    struct system_record ckpt[MX_EEPROM_MAP_SLOTS];
+#endif
+
+#ifdef MX_EEPROM_SUPERBLOCK
+    /* clean-shutdown superblock */
+    struct system_record sb_rec[MX_EEPROM_SB_SLOTS];
+    uint32_t sb_active[(MX_EEPROM_BLOCKS + 31) / 32]; /* blocks logged since the superblock */
+    uint32_t sb_entry; /* commit record of the superblock */
+    uint8_t sb_state; /* superblock state */
+#endif
+
+    osThreadId mount_caller; /* thread waiting for the mount */
+    int mount_ret; /* mount status */
+
+    osMutexId lock; /* bank mutex lock */
+
+    struct eeprom_stats stats; /* bank statistics */
+    struct eeprom_latency lat; /* bank latency histograms */
+    uint8_t erase_cause; /* cause of the erases in progress */
+    uint32_t wl_writes; /* page writes, not cleared by a statistics reset */
+    uint32_t wl_mark; /* page writes at the last wear leveling check */
+
+#ifdef MX_DEBUG
+   /* sector erase count statistics */
+   uint32_t eraseCnt[MX_EEPROM_BLOCKS][MX_EEPROM_SECTORS_PER_CLUSTER];
+#endif
+};
+
+/* RWW information */
+struct rww_info {
+    bool initialized; /* EEPROM status */
+
+#ifdef MX_FLASH_SUPPORT_RWW
+    uint32_t busyBank;          /* current busy bank */
+    TickType_t waitTicks;       /* ticks to wait */
+    osTimeOut timeout;          /* busy start time */
+    osMutexId busyLock;         /* RWW lock */
+#endif
+
+    osMutexId deviceLock; /* device lock */
+};
+
+/* Sequential stream */
+struct ra_stream {
+    uint32_t next; /* expected next address */
+    uint32_t seqCnt; /* sequential reads */
+    uint32_t raNext; /* next page to read ahead */
+    uint32_t age; /* last access time */
+};
+
+/* EEPROM information */
+struct eeprom_info {
+    bool initialized; /* EEPROM status */
+
+#ifdef MX_EEPROM_BACKGROUND_THREAD
+    bool bgStart;                     /* Background thread control */
+    osThreadId bgThreadID;            /* Background thread ID */
+#endif
+
+    struct bank_info bi[MX_EEPROMS]; /* bank info */
+
+#ifdef MX_EEPROM_READ_AHEAD
+    struct ra_stream ra[MX_EEPROM_RA_STREAMS]; /* sequential streams */
+    uint32_t raAge; /* stream LRU clock */
+    uint32_t raWindow; /* read-ahead window (pages) */
+    osMutexId raLock; /* stream mutex lock */
+    osMessageQId raQueue; /* read-ahead page queue */
+    osThreadId raThreadID; /* read-ahead thread ID */
+#endif
+
+#ifdef MX_EEPROM_DEFERRED_ERASE
+    osSemaphoreId eraseSem; /* erase thread wake-up */
+    osThreadId eraseThreadID; /* erase thread ID */
+    bool eraseStop; /* erase thread control */
+#endif
+
+#ifdef MX_EEPROM_GROUP_COMMIT
+    osMutexId gcLock; /* group commit mutex lock */
+    struct gc_waiter *gcWaiters; /* sync writers waiting for a flush */
+    uint32_t gcStarted; /* group flushes started */
+    uint32_t gcWriters; /* sync writers in flight */
+    bool gcLeader; /* group flush in flight */
+#endif
+
+#ifdef MX_EEPROM_TRANSACTION
+    osMutexId txLock; /* one transaction at a time */
+    osThreadId txOwner; /* thread of the open transaction */
+    uint32_t txBanks; /* banks held by the committing transaction, bitmap */
+    struct tx_buf txBuf[MX_EEPROM_TX_PAGES]; /* staged pages */
+    uint32_t txBufCnt; /* staged pages in use */
+    struct system_record txLog[MX_EEPROM_TX_PAGES + 1]; /* begin and page records */
+    uint32_t txLogCnt; /* logged records, 0 if no commit in progress */
+    bool txCommitted; /* commit record written */
+    uint8_t txObsolete[MX_EEPROM_TX_PAGES]; /* sectors superseded by the commit */
+#endif
+};
+
+/* EEPROM parameter */
+struct eeprom_param {
+    uint32_t eeprom_page_size;
+    uint32_t eeprom_bank_size;
+    uint32_t eeprom_banks;
+    uint32_t eeprom_total_size;
+    uint32_t eeprom_hash_algorithm;
+};
+
+#endif /* RWWEE_ENGINE_H_ */
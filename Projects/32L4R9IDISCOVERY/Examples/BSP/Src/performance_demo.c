@@ -16,7 +16,8 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
-#include <rwwee1.h>
+#include <rwwee.h>
+#include <rwwee2.h>
 #include "main.h"
 #include "mx_define.h"
 #include "cmsis_os.h"
@@ -548,7 +549,7 @@ static void Read_Thread3(void const *argument) {
     for (uint32_t i = 0; i < 8; i++) {
         R_LED(1);
         for (uint32_t j = 0; j < 8; j++) {
-            mx_eeprom_read(0x80000200 - 4, 0x200 - 4, RdData);
+            mx_eeprom_read(0x80000200 - 4, 0x200 - 4, (uint8_t*) RdData);
         }
         R_LED(0);
         EEPROM_ProcessBar(test_process++);
@@ -572,7 +573,7 @@ void eeprom_testflow(void) {
 
     for (uint8_t i = 0; i < 8; i++) {
         W_LED(1);
-        mx_eeprom_sync_write(0x80000000, 512 - 4, WrData);
+        mx_eeprom_sync_write(0x80000000, 512 - 4, (uint8_t*) WrData);
         W_LED(0);
         EEPROM_ProcessBar(test_process++);
     }
@@ -600,11 +601,406 @@ void eeprom_testflow(void) {
     BSP_LCD_Refresh();
 }
 
+#ifdef EEPROM_PERF_BENCH
+/*
+ * Benches of the "perf" partition, build with -DEEPROM_PERF_BENCH to run them.
+ * They overwrite its data, the geometry comes from rwwee2.h. Each one prints
+ * the statistics of its own run; rebuild with the engine option it exercises
+ * switched off to compare.
+ */
+#define BENCH_BASE          0x80000000
+
+static struct eeprom_stats bench_start;
+
+/* Start a bench run */
+static int bench_begin(void) {
+    return mx_eeprom_get_stats(BENCH_BASE, MX_EEPROM_ALL_BANKS, &bench_start);
+}
+
+/* End a bench run, return the statistics of the run */
+static int bench_end(struct eeprom_stats *delta) {
+    uint32_t i, *cnt = (uint32_t *)delta;
+    const uint32_t *start = (const uint32_t *)&bench_start;
+    int ret;
+
+    ret = mx_eeprom_get_stats(BENCH_BASE, MX_EEPROM_ALL_BANKS, delta);
+    if (ret)
+        return ret;
+
+    /* All counters are uint32_t */
+    for (i = 0; i < sizeof(*delta) / sizeof(uint32_t); i++)
+        cnt[i] -= start[i];
+
+    return MX_OK;
+}
+
+/* Microseconds since a DWT cycle count */
+static uint32_t bench_us(uint32_t start) {
+    return (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+}
+
+#define MAP_BENCH_ROUNDS    16
+
+/* Block switch latency, each round reads a new page of block 0 and 1 */
+static void eeprom_map_bench(void) {
+#if (MX_EEPROM_BLOCKS > 1)
+    struct eeprom_stats d;
+    uint32_t i, bank, switches;
+    uint8_t buf[4];
+
+    if (bench_begin())
+        return;
+
+    for (i = 0; i < MAP_BENCH_ROUNDS * 2; i++) {
+        for (bank = 0; bank < MX_EEPROMS; bank++)
+            mx_eeprom_read(BENCH_BASE + (i & 1) * MX_EEPROM_BLOCK_SIZE * MX_EEPROMS +
+                           ((i >> 1) * MX_EEPROMS + bank) * MX_EEPROM_PAGE_SIZE,
+                           sizeof(buf), buf);
+    }
+
+    if (bench_end(&d))
+        return;
+
+    switches = d.mapHitCnt + d.mapMissCnt;
+
+    printf("block switch: %lu (hit %lu, scan %lu, load %lu, save %lu), avg %lu cycles, %lu us\r\n",
+           switches, d.mapHitCnt, d.mapBuildCnt, d.mapLoadCnt, d.mapSaveCnt,
+           switches ? d.mapSwitchCycles / switches : 0,
+           switches ? d.mapSwitchCycles / switches / (SystemCoreClock / 1000000) : 0);
+#endif
+}
+
+#define RW_BENCH_ROUNDS     4
+#define RW_BENCH_MIN_SIZE   (4 * 1024)
+#define RW_BENCH_MAX_SIZE   (64 * 1024)
+
+static uint8_t rw_bench_buf[RW_BENCH_MAX_SIZE] __attribute__((aligned(4)));
+
+/* Sync write and read 4 KB - 64 KB requests spanning all banks */
+static void eeprom_rw_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i, size, start, wr, rd;
+
+    for (i = 0; i < RW_BENCH_MAX_SIZE; i++)
+        rw_bench_buf[i] = i;
+
+    for (size = RW_BENCH_MIN_SIZE; size <= RW_BENCH_MAX_SIZE; size *= 2) {
+        if (bench_begin())
+            return;
+
+        start = DWT->CYCCNT;
+        for (i = 0; i < RW_BENCH_ROUNDS; i++)
+            mx_eeprom_sync_write(BENCH_BASE, size, rw_bench_buf);
+        wr = bench_us(start);
+
+        start = DWT->CYCCNT;
+        for (i = 0; i < RW_BENCH_ROUNDS; i++)
+            mx_eeprom_read(BENCH_BASE, size, rw_bench_buf);
+        rd = bench_us(start);
+
+        if (bench_end(&d))
+            return;
+
+        printf("%2lu KB: write %lu KB/s, read %lu KB/s, worker sub-requests %lu, "
+               "zero-copy pages %lu/%lu\r\n",
+               size / 1024,
+               wr ? (uint32_t)((uint64_t)size * RW_BENCH_ROUNDS * 1000000 / 1024 / wr) : 0,
+               rd ? (uint32_t)((uint64_t)size * RW_BENCH_ROUNDS * 1000000 / 1024 / rd) : 0,
+               d.workerReqCnt, d.zcWriteCnt, d.zcReadCnt);
+    }
+}
+
+#define GC_BENCH_TASKS      4
+#define GC_BENCH_WRITES     32
+#define GC_BENCH_RECORD     16
+
+static volatile uint32_t gc_bench_done;
+
+static void GC_Bench_Thread(void const *argument) {
+    uint32_t i, addr = (uint32_t)argument;
+    uint8_t rec[GC_BENCH_RECORD];
+
+    for (i = 0; i < GC_BENCH_WRITES; i++) {
+        memset(rec, i, sizeof(rec));
+        mx_eeprom_sync_write(addr, sizeof(rec), rec);
+    }
+
+    taskENTER_CRITICAL();
+    gc_bench_done++;
+    taskEXIT_CRITICAL();
+    osThreadTerminate(NULL);
+}
+
+/* Several tasks sync write small records at the same time */
+static void eeprom_gc_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i, tasks = 0, start, us;
+    osThreadDef(GC_Bench, GC_Bench_Thread, osPriorityNormal, 0, 512);
+
+    if (bench_begin())
+        return;
+
+    gc_bench_done = 0;
+    start = DWT->CYCCNT;
+    for (i = 0; i < GC_BENCH_TASKS; i++) {
+        if (osThreadCreate(osThread(GC_Bench), (void *)(BENCH_BASE + i * MX_EEPROM_PAGE_SIZE)))
+            tasks++;
+    }
+
+    if (!tasks) {
+        printf("group commit: fail to start bench tasks\r\n");
+        return;
+    }
+
+    while (gc_bench_done < tasks)
+        osDelay(1);
+    us = bench_us(start);
+
+    if (bench_end(&d))
+        return;
+
+    printf("group commit: %lu sync writes in %lu us, %lu flushes, %lu.%02lu commits/flush\r\n",
+           tasks * GC_BENCH_WRITES, us, d.gcFlushCnt,
+           d.gcFlushCnt ? d.gcCommitCnt / d.gcFlushCnt : 0,
+           d.gcFlushCnt ? d.gcCommitCnt * 100 / d.gcFlushCnt % 100 : 0);
+}
+
+#define LOG_BENCH_WRITES    256UL
+#define LOG_BENCH_RECORD    16
+
+/* Sync write small records at random offsets of block 0, one flash write each */
+static void eeprom_log_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i, addr, seed = 1, start, us, total = 0, max = 0;
+    uint8_t rec[LOG_BENCH_RECORD];
+
+    if (bench_begin())
+        return;
+
+    for (i = 0; i < LOG_BENCH_WRITES; i++) {
+        seed = seed * 1103515245 + 12345;
+        addr = BENCH_BASE + (seed >> 8) % (MX_EEPROM_BLOCK_SIZE * MX_EEPROMS - sizeof(rec));
+        memset(rec, i, sizeof(rec));
+
+        start = DWT->CYCCNT;
+        mx_eeprom_sync_write(addr, sizeof(rec), rec);
+        us = bench_us(start);
+        total += us;
+        if (us > max)
+            max = us;
+    }
+
+    if (bench_end(&d))
+        return;
+
+#ifdef MX_EEPROM_PAGE_MAPPING
+    printf("page mapping: ");
+#else
+    printf("sector mapping: ");
+#endif
+    printf("%lu writes, avg %lu us, max %lu us, %lu erases (%lu.%02lu per write), "
+           "reclaimed %lu, copied %lu\r\n",
+           LOG_BENCH_WRITES, total / LOG_BENCH_WRITES, max, d.sectorEraseCnt,
+           d.sectorEraseCnt / LOG_BENCH_WRITES, d.sectorEraseCnt * 100 / LOG_BENCH_WRITES % 100,
+           d.reclaimCnt, d.reclaimCopyCnt);
+}
+
+#define DELTA_BENCH_WRITES  256
+#define DELTA_BENCH_COUNTERS 8
+
+/* Sync write 4-byte counters scattered over block 0, config and counter traffic */
+static void eeprom_delta_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i, addr, start, us;
+
+    if (bench_begin())
+        return;
+
+    start = DWT->CYCCNT;
+    for (i = 0; i < DELTA_BENCH_WRITES; i++) {
+        addr = BENCH_BASE + (i % DELTA_BENCH_COUNTERS) * (MX_EEPROM_BLOCK_SIZE * MX_EEPROMS / DELTA_BENCH_COUNTERS);
+        mx_eeprom_sync_write(addr, sizeof(i), (uint8_t *)&i);
+    }
+    us = bench_us(start);
+
+    if (bench_end(&d) || !d.writeBytes)
+        return;
+
+#ifdef MX_EEPROM_DELTA_JOURNAL
+    printf("delta journal: ");
+#else
+    printf("whole entries: ");
+#endif
+    printf("%lu bytes written, %lu programmed (%lu.%02lu per byte), %lu records, "
+           "%lu compactions, %lu erases, %lu us\r\n",
+           d.writeBytes, d.progBytes, d.progBytes / d.writeBytes,
+           d.progBytes * 100 / d.writeBytes % 100,
+           d.deltaCnt, d.deltaCompactCnt, d.sectorEraseCnt, us);
+}
+
+#define ZIP_BENCH_WRITES    64
+#define ZIP_BENCH_FIELDS    16
+
+static uint8_t zip_bench_page[MX_EEPROM_PAGE_SIZE];
+
+/* Sync write whole pages of zero-filled config with a few fields set */
+static void eeprom_zip_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i, j, val, addr, start, us;
+
+    if (bench_begin())
+        return;
+
+    start = DWT->CYCCNT;
+    for (i = 0; i < ZIP_BENCH_WRITES; i++) {
+        memset(zip_bench_page, 0, sizeof(zip_bench_page));
+        for (j = 0; j < ZIP_BENCH_FIELDS; j++) {
+            val = i * j + 1;
+            memcpy(&zip_bench_page[j * (sizeof(zip_bench_page) / ZIP_BENCH_FIELDS)], &val, sizeof(val));
+        }
+
+        addr = BENCH_BASE + (i % MX_EEPROMS) * MX_EEPROM_PAGE_SIZE;
+        mx_eeprom_sync_write(addr, sizeof(zip_bench_page), zip_bench_page);
+    }
+    us = bench_us(start);
+
+    if (bench_end(&d) || !d.writeBytes)
+        return;
+
+#ifdef MX_EEPROM_COMPRESSION
+    printf("compressed: ");
+#else
+    printf("plain: ");
+#endif
+    printf("%lu bytes written, %lu programmed (%lu.%02lu per byte), %lu pages compressed, "
+           "ratio %lu.%02lu, %lu erases, %lu us (%lu KB/s)\r\n",
+           d.writeBytes, d.progBytes, d.progBytes / d.writeBytes,
+           d.progBytes * 100 / d.writeBytes % 100, d.zipCnt,
+           d.zipInBytes ? d.zipOutBytes / d.zipInBytes : 0,
+           d.zipInBytes ? d.zipOutBytes * 100 / d.zipInBytes % 100 : 0,
+           d.sectorEraseCnt, us, us ? d.writeBytes * 1000 / 1024 * 1000 / us : 0);
+}
+
+/* Remount after an unclean and a clean shutdown */
+static void eeprom_mount_bench(void) {
+    struct eeprom_stats stats;
+    uint32_t i, start, us;
+    uint8_t buf[4] = { 0 };
+
+    for (i = 0; i < 2; i++) {
+        if (i)
+            mx_eeprom_flush();
+        else
+            mx_eeprom_sync_write(BENCH_BASE, sizeof(buf), buf);
+
+        mx_eeprom_deinit();
+
+        start = DWT->CYCCNT;
+        if (mx_eeprom_init())
+            return;
+        us = bench_us(start);
+
+        if (mx_eeprom_get_stats(BENCH_BASE, MX_EEPROM_ALL_BANKS, &stats))
+            return;
+
+        printf("%s mount: %lu us, %lu blocks searched, %lu restored, avg %lu cycles per bank\r\n",
+               i ? "clean" : "unclean", us, stats.mountScanCnt, stats.mountSkipCnt,
+               stats.mountCycles / MX_EEPROMS);
+    }
+}
+
+#define CRC_BENCH_ROUNDS    8
+
+/* Whole-page reads bypass the cache, so every round re-checks all banks */
+static void eeprom_crc_bench(void) {
+    struct eeprom_stats d;
+    uint32_t i;
+
+#if MX_EEPROM_CRC_BACKEND == MX_EEPROM_CRC_BACKEND_HW
+    const char *name = "hw";
+#elif MX_EEPROM_CRC_BACKEND == MX_EEPROM_CRC_BACKEND_DMA
+    const char *name = "dma";
+#else
+    const char *name = "table";
+#endif
+
+    if (bench_begin())
+        return;
+
+    for (i = 0; i < CRC_BENCH_ROUNDS; i++)
+        mx_eeprom_read(BENCH_BASE, RW_BENCH_MAX_SIZE, rw_bench_buf);
+
+    if (bench_end(&d))
+        return;
+
+    printf("crc %s: %lu KB, %lu KB/s, lock wait %lu cycles per KB\r\n",
+           name, d.crcBytes / 1024,
+           d.crcCycles ? (uint32_t)((uint64_t)d.crcBytes * SystemCoreClock / 1024 / d.crcCycles) : 0,
+           d.crcBytes ? (uint32_t)((uint64_t)d.crcWaitCycles * 1024 / d.crcBytes) : 0);
+}
+
+static void eeprom_stats_dump(void) {
+    struct eeprom_stats stats;
+    uint32_t bank;
+
+    for (bank = 0; bank < MX_EEPROMS; bank++) {
+        if (mx_eeprom_get_stats(BENCH_BASE, bank, &stats))
+            return;
+
+        printf("bank %lu: %lu reads, %lu writes, %lu cache hits, %lu flushes, %lu erases, "
+               "%lu WL moves, %lu CRC errors, %lu read retries\r\n",
+               bank, stats.pageReadCnt, stats.pageWriteCnt, stats.cacheHitCnt,
+               stats.cacheFlushCnt, stats.sectorEraseCnt, stats.wlCnt,
+               stats.crcErrCnt, stats.readRetryCnt);
+
+        printf("bank %lu: WA %lu.%02lu, %lu KB user, %lu KB entries (GC %lu KB, WL %lu KB), "
+               "%lu KB system, erases user %lu, GC %lu, WL %lu, repair %lu, system %lu\r\n",
+               bank, mx_eeprom_wa_ratio(&stats) / 100, mx_eeprom_wa_ratio(&stats) % 100,
+               stats.writeBytes / 1024, stats.progBytes / 1024, stats.gcProgBytes / 1024,
+               stats.wlProgBytes / 1024, stats.sysProgBytes / 1024, stats.eraseUserCnt,
+               stats.eraseGcCnt, stats.eraseWlCnt, stats.eraseFixCnt, stats.eraseSysCnt);
+    }
+}
+
+#define LAT_BENCH_ROUNDS    16
+
+/* Small scattered updates with read-back, flushed and erased along the way */
+static void eeprom_latency_bench(void) {
+    uint32_t i, ofs;
+
+    if (mx_eeprom_reset_stats(BENCH_BASE, MX_EEPROM_ALL_BANKS))
+        return;
+
+    for (i = 0; i < LAT_BENCH_ROUNDS; i++) {
+        for (ofs = 0; ofs < RW_BENCH_MAX_SIZE; ofs += MX_EEPROM_PAGE_SIZE) {
+            rw_bench_buf[ofs] = i;
+            mx_eeprom_write(BENCH_BASE + ofs, 16, &rw_bench_buf[ofs]);
+            mx_eeprom_read(BENCH_BASE + ofs, 16, &rw_bench_buf[ofs]);
+        }
+        mx_eeprom_flush();
+    }
+
+    mx_eeprom_dump_latency(BENCH_BASE, MX_EEPROM_ALL_BANKS);
+}
+#endif
+
 void eeprom_perf_demo(void) {
     led_mutex = xSemaphoreCreateMutex();
     eeprom_perf_demo_display();
     rww_testflow2();
     eeprom_testflow();
+#ifdef EEPROM_PERF_BENCH
+    eeprom_map_bench();
+    eeprom_rw_bench();
+    eeprom_gc_bench();
+    eeprom_log_bench();
+    eeprom_delta_bench();
+    eeprom_zip_bench();
+    eeprom_mount_bench();
+    eeprom_crc_bench();
+    eeprom_stats_dump();
+    eeprom_latency_bench();
+#endif
 
     if (MfxItOccurred == SET) {
         Mfx_Event();